@@ -0,0 +1,109 @@
+/*------------------------------------------------------------------------------
+  L I B P R I M E S - I N T E R N A L . H
+
+  Interne Schnittstelle des Siebs in libprimes.c, auf der primes.c aufsetzt
+
+  Nicht Teil der Bibliothek: Namen, Datentypen und Funktionen können sich
+  jederzeit ändern. Programme, die libprimes verwenden, binden nur libprimes.h
+  ein.
+------------------------------------------------------------------------------*/
+#ifndef LIBPRIMES_INTERNAL_H
+#define LIBPRIMES_INTERNAL_H
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "libprimes.h"
+
+/*------------------------------------------------------------------------------
+  Datentypen
+------------------------------------------------------------------------------*/
+typedef uint64_t uint64;
+typedef uint32_t uint32;
+typedef int64_t  int64;
+typedef int32_t  int32;
+typedef uint16_t uint16;
+typedef uint8_t  uint8;
+
+typedef struct {
+  uint32 prime;  /* Primzahl / 30 * 8 + Index des Rests der Primzahl */
+  uint32 index;  /* Byte im Segment * 8 + Index des Rests des Faktors */
+} SievingPrime;
+
+#define BUCKET_CAPACITY    1023
+#define PI_MAX             425656284035217743ULL  /* pi(2^64 - 1) */
+#define PRIME_ANCHOR_SHIFT 8   /* alle 2^8 Primfaktoren ein absoluter Wert */
+
+/* Die Primfaktoren >= 7 als halbe Abstände zum jeweils vorigen (vor 7: 5), die
+   unter 2^32 alle in ein Byte passen; für den direkten Zugriff ist jeder
+   2^PRIME_ANCHOR_SHIFT-te zusätzlich als Wert abgelegt. */
+typedef struct {
+  uint8*  gaps;
+  uint32* anchors;
+  uint32  count;
+  uint32  largest;   /* 0, wenn es keinen gibt */
+} PrimeFactors;
+
+typedef struct Bucket {
+  struct Bucket* next;
+  uint32         count;
+  SievingPrime   primes[BUCKET_CAPACITY];
+} Bucket;
+
+typedef struct {
+  Bucket** segments;       /* je kommendem Segment eine Liste von Buckets */
+  uint32   segments_mask;
+  uint64   segment;        /* Nummer des aktuellen Segments */
+  uint32   sieve_shift;    /* log2 der Größe eines Segments */
+  uint64   end_byte;       /* Byte von to; spätere Vielfache fallen heraus */
+  Bucket*  free_buckets;
+} BucketSieve;
+
+typedef struct {
+  const PrimeFactors* factors;
+  uint32      primes_count;   /* Anzahl der verwendeten Primfaktoren */
+  uint32*     medium_primes;  /* Primfaktoren <= 4 * Segmentgröße ... */
+  uint32      medium_count;   /* ... und deren Anzahl */
+  uint32      factors_count;  /* Anzahl der bereits aufgenommenen Primfaktoren */
+  uint32      next_factor;    /* der nächste aufzunehmende Primfaktor */
+  uint32      presieved;      /* Anzahl der Primfaktoren im Vorsieb */
+  uint64*     multiples;      /* nächste Vielfache der mittleren Primfaktoren */
+  BucketSieve buckets;        /* nächste Vielfache der großen Primfaktoren */
+  uint32      sieve_size;
+} SegmentedSieve;
+
+/*------------------------------------------------------------------------------
+  Prototypen
+------------------------------------------------------------------------------*/
+uint32 primes_calc_square_roots(uint64 n, uint32* sqrts);
+void primes_build_prime_factors(PrimeFactors* factors, uint32 prime_factors_count_estimated);
+void primes_add_prime_factor(PrimeFactors* factors, uint32 prime);
+uint32 primes_count_prime_factors_up_to(uint32 x, const PrimeFactors* factors);
+void primes_free_prime_factors(PrimeFactors* factors);
+uint32 primes_calc_sieve_size(uint64 n, uint32 sieve_size_requested);
+uint8* primes_build_sieve(uint32 sieve_size);
+void primes_calc_prime_factors(uint32 sqrts_top, uint32* sqrts, PrimeFactors* factors, uint8* sieve, uint32 sieve_size);
+void primes_init_segmented_sieve(SegmentedSieve* s, const PrimeFactors* factors, uint32 primes_count, uint32 sieve_size, uint64 to);
+void primes_sieve_next_segment(SegmentedSieve* s, uint8* sieve, uint64 low_byte);
+void primes_free_segmented_sieve(SegmentedSieve* s);
+void primes_init_wheel(void);
+void primes_limit_segment(uint8* sieve, uint64 low_byte, uint32 size, uint64 from, uint64 to);
+uint64 primes_count_segment_primes(uint8* sieve, uint32 size);
+uint64 primes_first_segment_prime(uint8* sieve, uint64 low_byte, uint32 size);
+uint64 primes_last_segment_prime(uint8* sieve, uint64 low_byte, uint32 size);
+uint64 primes_count_segment_primes_up_to(uint8* sieve, uint64 low_byte, uint64 v);
+uint64 primes_count_primes_up_to(uint64 x, const PrimeFactors* factors, uint32 sieve_size);
+uint64 primes_find_nth_prime(uint64 k, const PrimeFactors* factors, uint8* sieve, uint32 sieve_size);
+uint64 primes_nth_prime_limit(uint64 k);
+uint32 primes_estimate_number_of_primes_up_to(uint32 x);
+
+extern uint32 primes_wheel_offsets[64];  /* Bit in einem 64-Bit-Wort -> Abstand zum Wortanfang */
+
+#ifdef _MSC_VER
+static int ctz64(uint64 x) { unsigned long i; _BitScanForward64(&i, x); return (int) i; }
+#else
+#define ctz64(x) __builtin_ctzll(x)
+#endif
+
+#endif
@@ -0,0 +1,1811 @@
+/*------------------------------------------------------------------------------
+  L I B P R I M E S . C
+
+  Segmentiertes Sieb des Eratosthenes (Rad modulo 30, Bucket Sieve) und pi(x)
+  nach Lagarias, Miller und Odlyzko
+
+  Die Schnittstelle ist in libprimes.h beschrieben, die interne für primes.c in
+  libprimes-internal.h; alles andere ist static. Außer den Tabellen des Rads und
+  des Vorsiebs, die einmalig berechnet werden, gibt es keinen globalen Zustand.
+------------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "libprimes-internal.h"
+
+/*------------------------------------------------------------------------------
+  Datentypen
+------------------------------------------------------------------------------*/
+struct PrimesContext {
+  uint64  from;
+  uint64  to;
+  uint32  small;              /* Index der nächsten der Primzahlen 2, 3, 5 */
+  PrimeFactors factors;       /* Primfaktoren bis sqrt(to) */
+  SegmentedSieve s;
+  uint8*  sieve;
+  uint32  sieve_size;
+  uint64  low_byte;           /* Beginn des nächsten Segments */
+  uint64  segment_byte;       /* Beginn des aktuellen Segments */
+  uint32  pos;                /* nächstes Wort im aktuellen Segment */
+  uint64  word;               /* noch nicht gelieferte Bits des aktuellen Worts */
+  uint64* batch;              /* Primzahlen eines Segments für primes_generate */
+  uint32  batch_capacity;
+};
+
+typedef struct {
+  uint64* sieve;              /* Segment, 1 Bit je Zahl */
+  uint32* counters;           /* Anzahl der gesetzten Bits je Block */
+  uint32  block_shift;        /* Blockgröße = 2^block_shift Bits */
+  uint32  block;              /* erster Block nach der letzten Abfrage ... */
+  int64   sum;                /* ... und Anzahl der Bits davor */
+  int64   total;              /* Anzahl der Bits im Segment */
+} LeafCounter;
+
+typedef struct {
+  uint64 n;
+  uint64 n_inverse;           /* n^-1 mod 2^64 */
+  uint64 r2;                  /* 2^128 mod n */
+  uint64 one;                 /* 1 bzw. -1 in Montgomery-Darstellung */
+  uint64 minus_one;
+  uint64 d;                   /* n - 1 = d * 2^s, d ungerade */
+  uint32 s;
+} Montgomery;
+
+#define MILLER_RABIN_LANES 4
+
+/*------------------------------------------------------------------------------
+  Prototypen
+------------------------------------------------------------------------------*/
+static int next_segment(PrimesContext* ctx);
+static uint32 take_segment_primes(PrimesContext* ctx);
+static uint32 prime_factor(const PrimeFactors* factors, uint32 i);
+static uint64* build_multiples(uint32 primes_count);
+static void build_wheel(void);
+#ifdef _WIN32
+static BOOL CALLBACK build_wheel_once(PINIT_ONCE once, PVOID parameter, PVOID* context);
+#endif
+static void presieve_segment(uint8* sieve, uint64 low_byte, uint32 size);
+static void sieve_segment(uint8* sieve, uint64 low_byte, uint32 size, const PrimeFactors* factors, uint32 primes_count);
+static uint64 first_multiple(uint32 prime, uint64 low_byte);
+static uint64 cross_off_multiples(uint8* sieve, uint64 low_byte, uint32 size, uint32 prime, uint64 multiple);
+static void init_bucket_sieve(BucketSieve* buckets, uint32 max_prime, uint32 sieve_size, uint64 to);
+static void add_to_buckets(BucketSieve* buckets, uint64 low_byte, uint32 prime, uint64 multiple);
+static void store_in_bucket(BucketSieve* buckets, uint64 segment, uint32 prime, uint32 index);
+static void cross_off_large_primes(BucketSieve* buckets, uint8* sieve, uint64 low_byte);
+static void free_bucket_sieve(BucketSieve* buckets);
+static void store_segment_primes(uint8* sieve, uint64 low_byte, uint32 size, PrimeFactors* factors);
+static uint64 nth_segment_prime(uint8* sieve, uint64 low_byte, uint32 size, uint64 n);
+static int32* build_factors(uint32 y, uint32 a, const uint32* lmo_primes);
+static uint16* build_phi_table(uint32 c);
+static int64 calc_ordinary_leaves(uint64 x, uint32 y, uint32 c, const int32* factors, const uint16* phi_table);
+static int64 calc_special_leaves(uint64 x, uint32 y, uint32 c, uint32 a, const uint32* lmo_primes, const int32* factors, const uint16* phi_table);
+static void init_leaf_counter(LeafCounter* counter, const uint64* pattern, uint32 offset, uint32 size, uint32 segment_size);
+static int64 count_leaves(LeafCounter* counter, uint32 pos);
+static void cross_off_leaf_multiples(LeafCounter* counter, uint32 size, uint64 low, uint32 prime, uint64* multiple);
+static uint64 calc_p2(uint64 x, uint32 y, uint32 a, const PrimeFactors* factors, uint32 sieve_size);
+static int trial_division(uint64 n);
+static void init_montgomery(Montgomery* m, uint64 n);
+static void miller_rabin_lanes(const Montgomery* m, uint32 lanes, uint64 base, uint8* probable);
+static uint64 montgomery_multiply(const Montgomery* m, uint64 a, uint64 b);
+static uint64 multiply_64x64(uint64 a, uint64 b, uint64* high);
+static uint32 integer_square_root(uint64 x);
+static uint32 integer_cube_root(uint64 x);
+static double approximate_pi(double x);
+static uint64 approximate_nth_prime(uint64 k);
+static double logarithmic_integral(double x);
+static int moebius(uint32 n);
+static uint32 detect_cache_size(void);
+
+/*------------------------------------------------------------------------------
+  globale Variablen
+------------------------------------------------------------------------------*/
+static const uint64 small_primes[3] = { 2, 3, 5 };  /* fehlen im Sieb */
+
+/*------------------------------------------------------------------------------
+  Das Rad (wheel) modulo 30
+
+  Ein Byte des Siebs steht für 30 aufeinanderfolgende Zahlen, von denen nur die
+  8 zu 2, 3 und 5 teilerfremden Zahlen (Reste 1, 7, 11, ... 29) ein Bit haben.
+  Ein gesetztes Bit bedeutet: (noch) Kandidat für eine Primzahl.
+------------------------------------------------------------------------------*/
+static const uint32 wheel_residues[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+static const uint32 wheel_gaps[8]     = { 6, 4,  2,  4,  2,  4,  6,  2 };
+
+static uint8  wheel_index[30];    /* Rest mod 30 -> Index des nächsten Rests >= */
+static uint8  wheel_unset[8][8];  /* [Primzahl-Rest][Faktor-Rest] -> Maske zum Löschen */
+static uint32 wheel_carry[8][8];  /* [Primzahl-Rest][Faktor-Rest] -> Byte-Übertrag */
+uint32 primes_wheel_offsets[64];  /* Bit in einem 64-Bit-Wort -> Abstand zum Wortanfang */
+
+/*------------------------------------------------------------------------------
+  Vorsieb für die Primzahlen 7 bis 19
+
+  Die Vielfachen von 7, 11, 13, 17 und 19 wiederholen sich im Sieb alle
+  7 * 11 * 13 * 17 * 19 Bytes. Ein Segment wird deshalb nicht mit 0xFF gefüllt,
+  sondern mit dem passenden Ausschnitt dieses Musters; gestrichen wird dann erst
+  ab der Primzahl 23. Das spart etwa die Hälfte aller Schreibzugriffe.
+------------------------------------------------------------------------------*/
+#define PRESIEVE_MAX_PRIME  19
+#define PRESIEVE_SIZE       (7 * 11 * 13 * 17 * 19)
+
+static uint8  presieve_pattern[PRESIEVE_SIZE];
+
+/*------------------------------------------------------------------------------
+  Primorials p_c# und deren Werte der Eulerschen Phi-Funktion für die ersten
+  c Primzahlen (c <= PHI_TINY_MAX); dient phi(x, c) in konstanter Zeit.
+------------------------------------------------------------------------------*/
+#define PHI_TINY_MAX 6
+
+static const uint32 phi_primes[PHI_TINY_MAX + 1]     = { 1, 2, 3, 5, 7, 11, 13 };
+static const uint32 phi_primorials[PHI_TINY_MAX + 1] = { 1, 2, 6, 30, 210, 2310, 30030 };
+static const uint32 phi_totients[PHI_TINY_MAX + 1]   = { 1, 1, 2, 8, 48, 480, 5760 };
+
+/*------------------------------------------------------------------------------
+  Basen, mit denen der Miller-Rabin-Test für alle n < 2^64 deterministisch ist
+  (Jim Sinclair, 2011), und Primzahlen für die Probedivision davor
+------------------------------------------------------------------------------*/
+#define MILLER_RABIN_BASES_COUNT 7
+#define TRIAL_PRIMES_COUNT       15
+
+static const uint64 miller_rabin_bases[MILLER_RABIN_BASES_COUNT] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+static const uint32 trial_primes[TRIAL_PRIMES_COUNT] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47 };
+
+/*------------------------------------------------------------------------------
+  Macros
+------------------------------------------------------------------------------*/
+#define odd(n) ((n - 1) | 1)
+
+#ifdef _MSC_VER
+static int clz64(uint64 x) { unsigned long i; _BitScanReverse64(&i, x); return 63 - (int) i; }
+#else
+#define clz64(x) __builtin_clzll(x)
+#endif
+
+#ifdef _MSC_VER
+#define popcount64(x) __popcnt64(x)
+#else
+#define popcount64(x) __builtin_popcountll(x)
+#endif
+
+/* Funktionen, die viel zählen, werden (GCC bzw. Clang, Linux, x86-64) auch mit
+   dem POPCNT-Befehl übersetzt; welche Fassung läuft, entscheidet der Loader
+   einmal beim Start per CPUID (ifunc). Ohne POPCNT zählt eine Software-Routine. */
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__) && !defined(__POPCNT__)
+#define CPU_DISPATCH __attribute__((target_clones("popcnt", "default")))
+#else
+#define CPU_DISPATCH
+#endif
+
+/*==============================================================================
+  Schnittstelle
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Legt einen Kontext für die Primzahlen zwischen from und to an.
+  sieve_size ist die Größe eines Siebsegments in Bytes (0: nach dem Cache).
+------------------------------------------------------------------------------*/
+PrimesContext* primes_create(uint64 from, uint64 to, uint32 sieve_size) {
+  PrimesContext* ctx = calloc(1, sizeof(PrimesContext));
+
+  if (ctx == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  primes_init_wheel();
+
+  ctx->from = from;
+  ctx->to = to;
+  ctx->sieve_size = primes_calc_sieve_size(to, sieve_size);
+  ctx->sieve = primes_build_sieve(ctx->sieve_size);
+  if (to >= 7) {
+    uint32 sqrts[5];
+    uint32 sqrts_top = primes_calc_square_roots(to, sqrts);
+    primes_build_prime_factors(&ctx->factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+    primes_calc_prime_factors(sqrts_top, sqrts, &ctx->factors, ctx->sieve, ctx->sieve_size);
+  }
+  primes_init_segmented_sieve(&ctx->s, &ctx->factors, ctx->factors.count, ctx->sieve_size, to);
+
+  /* 2, 3 und 5 hat das Sieb nicht; ohne Zahlen >= 7 gibt es kein Segment */
+  ctx->low_byte = (from > 7) ? from / 30 : 0;
+  if (to < 7 || from > to) {
+    ctx->low_byte = to / 30 + 1;
+  }
+  ctx->pos = ctx->sieve_size;
+  next_segment(ctx);
+  return ctx;
+}
+
+/*------------------------------------------------------------------------------
+  Liefert die nächste Primzahl; 0, wenn es keine mehr gibt.
+------------------------------------------------------------------------------*/
+int primes_next(PrimesContext* ctx, uint64* prime) {
+  while (ctx->small < 3) {
+    uint64 p = small_primes[ctx->small++];
+    if (p >= ctx->from && p <= ctx->to) {
+      *prime = p;
+      return 1;
+    }
+  }
+  while (ctx->word == 0) {
+    if (ctx->pos >= ctx->sieve_size && !next_segment(ctx)) {
+      return 0;
+    }
+    memcpy(&ctx->word, ctx->sieve + ctx->pos, sizeof(ctx->word));
+    ctx->pos += 8;
+  }
+  *prime = (ctx->segment_byte + ctx->pos - 8) * 30 + primes_wheel_offsets[ctz64(ctx->word)];
+  ctx->word &= ctx->word - 1;
+  return 1;
+}
+
+/*------------------------------------------------------------------------------
+  Übergibt die (restlichen) Primzahlen segmentweise als Array an callback, bis
+  alle geliefert sind oder callback einen Wert != 0 zurückgibt.
+  Zurückgegeben wird die Anzahl der übergebenen Primzahlen.
+------------------------------------------------------------------------------*/
+uint64 primes_generate(PrimesContext* ctx, PrimesCallback callback, void* user_data) {
+  uint64 total = 0;
+
+  do {
+    uint32 count = take_segment_primes(ctx);
+    if (count > 0) {
+      total += count;
+      if (callback(ctx->batch, count, user_data) != 0) {
+        break;
+      }
+    }
+  } while (next_segment(ctx));
+  return total;
+}
+
+/*------------------------------------------------------------------------------
+  Gibt einen Kontext wieder frei.
+------------------------------------------------------------------------------*/
+void primes_destroy(PrimesContext* ctx) {
+  primes_free_segmented_sieve(&ctx->s);
+  free(ctx->batch);
+  free(ctx->sieve);
+  primes_free_prime_factors(&ctx->factors);
+  free(ctx);
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet pi(x), die Anzahl der Primzahlen <= x.
+------------------------------------------------------------------------------*/
+uint64 primes_pi(uint64 x) {
+  if (x < 7) {
+    return (x >= 2) + (x >= 3) + (x >= 5);
+  }
+  primes_init_wheel();
+
+  uint32 sqrts[5];
+  uint32 sqrts_top = primes_calc_square_roots(x, sqrts);
+  PrimeFactors factors;
+  primes_build_prime_factors(&factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+  uint32 sieve_size = primes_calc_sieve_size(x, 0);
+  uint8* sieve = primes_build_sieve(sieve_size);
+  primes_calc_prime_factors(sqrts_top, sqrts, &factors, sieve, sieve_size);
+
+  uint64 pi = primes_count_primes_up_to(x, &factors, sieve_size);
+  free(sieve);
+  primes_free_prime_factors(&factors);
+  return pi;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet die k-te Primzahl; 0, wenn es sie unter 2^64 nicht gibt.
+------------------------------------------------------------------------------*/
+uint64 primes_nth(uint64 k) {
+  if (k == 0 || k > PI_MAX) {
+    return 0;
+  }
+  primes_init_wheel();
+
+  uint64 limit = primes_nth_prime_limit(k);
+  uint32 sqrts[5];
+  uint32 sqrts_top = primes_calc_square_roots(limit, sqrts);
+  PrimeFactors factors;
+  primes_build_prime_factors(&factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+  uint32 sieve_size = primes_calc_sieve_size(limit, 0);
+  uint8* sieve = primes_build_sieve(sieve_size);
+  primes_calc_prime_factors(sqrts_top, sqrts, &factors, sieve, sieve_size);
+
+  uint64 prime = primes_find_nth_prime(k, &factors, sieve, sieve_size);
+  free(sieve);
+  primes_free_prime_factors(&factors);
+  return prime;
+}
+
+/*------------------------------------------------------------------------------
+  Prüft, ob n eine Primzahl ist (deterministischer Miller-Rabin-Test); ohne
+  Sieb und ohne Primfaktoren bis sqrt(n), also auch für einzelne große Zahlen.
+------------------------------------------------------------------------------*/
+int primes_is_prime(uint64 n) {
+  uint8 result;
+
+  primes_is_prime_batch(&n, 1, &result);
+  return result;
+}
+
+/*------------------------------------------------------------------------------
+  Prüft count Zahlen auf einmal: results[i] = 1, wenn numbers[i] eine Primzahl
+  ist, sonst 0. Nach der Probedivision laufen die Tests für jeweils
+  MILLER_RABIN_LANES Zahlen verschränkt, die Multiplikationen der einzelnen
+  Zahlen können so überlappend ausgeführt werden. Die meisten zusammengesetzten
+  Zahlen scheitern schon an der Basis 2; für die weiteren Basen werden die
+  übrigen Zahlen neu gebündelt.
+------------------------------------------------------------------------------*/
+void primes_is_prime_batch(const uint64* numbers, uint32 count, uint8* results) {
+  Montgomery m[MILLER_RABIN_LANES];
+  uint32 index[MILLER_RABIN_LANES];
+  uint8 probable[MILLER_RABIN_LANES];
+
+  for (uint32 b = 0; b < MILLER_RABIN_BASES_COUNT; b++) {
+    uint32 lanes = 0;
+    for (uint32 i = 0; i <= count; i++) {
+      if (i < count) {
+        if (b == 0) {
+          results[i] = (uint8) trial_division(numbers[i]);
+        }
+        if (results[i] == 2) {
+          init_montgomery(&m[lanes], numbers[i]);
+          index[lanes++] = i;
+        }
+      }
+      if (lanes == MILLER_RABIN_LANES || i == count && lanes > 0) {
+        miller_rabin_lanes(m, lanes, miller_rabin_bases[b], probable);
+        for (uint32 k = 0; k < lanes; k++) {
+          results[index[k]] = probable[k] ? 2 : 0;
+        }
+        lanes = 0;
+      }
+    }
+  }
+  for (uint32 i = 0; i < count; i++) {
+    results[i] = (results[i] != 0);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Siebt das nächste Segment des Kontexts; 0, wenn es keines mehr gibt.
+------------------------------------------------------------------------------*/
+static int next_segment(PrimesContext* ctx) {
+  if (ctx->low_byte > ctx->to / 30) {
+    return 0;
+  }
+  primes_sieve_next_segment(&ctx->s, ctx->sieve, ctx->low_byte);
+  primes_limit_segment(ctx->sieve, ctx->low_byte, ctx->sieve_size, (ctx->from > 7) ? ctx->from : 7, ctx->to);
+  ctx->segment_byte = ctx->low_byte;
+  ctx->low_byte += ctx->sieve_size;
+  ctx->pos = 0;
+  ctx->word = 0;
+  return 1;
+}
+
+/*------------------------------------------------------------------------------
+  Notiert die noch nicht gelieferten Primzahlen des aktuellen Segments (und
+  davor 2, 3 und 5) in ctx->batch. Zurückgegeben wird deren Anzahl.
+------------------------------------------------------------------------------*/
+static uint32 take_segment_primes(PrimesContext* ctx) {
+  uint32 pos = ctx->pos;
+  uint32 needed = 3 + (uint32) popcount64(ctx->word)
+                    + (uint32) primes_count_segment_primes(ctx->sieve + pos, ctx->sieve_size - pos);
+  uint32 count = 0;
+
+  if (needed > ctx->batch_capacity) {
+    free(ctx->batch);
+    if ((ctx->batch = malloc(needed * sizeof(uint64))) == NULL) {
+      perror("memory error");
+      exit(2);
+    }
+    ctx->batch_capacity = needed;
+  }
+  while (ctx->small < 3) {
+    uint64 p = small_primes[ctx->small++];
+    if (p >= ctx->from && p <= ctx->to) {
+      ctx->batch[count++] = p;
+    }
+  }
+  while (ctx->word != 0) {
+    ctx->batch[count++] = (ctx->segment_byte + pos - 8) * 30 + primes_wheel_offsets[ctz64(ctx->word)];
+    ctx->word &= ctx->word - 1;
+  }
+  for (; pos < ctx->sieve_size; pos += 8) {
+    uint64 word;
+    memcpy(&word, ctx->sieve + pos, sizeof(word));
+    while (word != 0) {
+      ctx->batch[count++] = (ctx->segment_byte + pos) * 30 + primes_wheel_offsets[ctz64(word)];
+      word &= word - 1;
+    }
+  }
+  ctx->pos = ctx->sieve_size;
+  return count;
+}
+
+/*==============================================================================
+  Sieb
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Berechnet alle ungeraden Quadratwurzeln von n, solange bis der Wert 3 erreicht.
+  Statt 1 (== sqrt(3..8)) wird 3 verwendet. 
+  Zurückgegeben wird der Index der kleinsten (= Anzahl - 1).
+------------------------------------------------------------------------------*/
+uint32 primes_calc_square_roots(uint64 n, uint32* sqrts) {
+  uint32 top = -1;
+  do {
+    sqrts[++top] = n = odd(integer_square_root(n));
+  } while (n > 3);
+  if (sqrts[top] == 1) {
+    sqrts[top] = 3;
+  }
+  return top;
+}
+
+/*------------------------------------------------------------------------------
+  Legt leere Primfaktoren an, die für die angegebene Anzahl ausreichen.
+
+  Je Primfaktor wird 1 Byte benötigt statt 4 als Wert; bis 2^32 sind das rund
+  200 MB statt 800 MB, die Anker kosten dazu weniger als 2 %. Das gilt nur für
+  die Primfaktoren selbst: beim Sieben kommen 8 Bytes je Primfaktor in einem
+  Bucket hinzu (siehe primes_init_segmented_sieve), nahe 2^64 bei einem Bereich
+  von 3 * 10^8 zusammen rund 360 MB.
+------------------------------------------------------------------------------*/
+void primes_build_prime_factors(PrimeFactors* factors, uint32 prime_factors_count_estimated) {
+  size_t anchors_count = (prime_factors_count_estimated >> PRIME_ANCHOR_SHIFT) + 1;
+
+  factors->gaps = malloc(prime_factors_count_estimated + 1);
+  factors->anchors = malloc(anchors_count * sizeof(factors->anchors[0]));
+  if (factors->gaps == NULL || factors->anchors == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  factors->count = 0;
+  factors->largest = 0;
+}
+
+/*------------------------------------------------------------------------------
+  Hängt einen Primfaktor an (größer als alle bisherigen).
+------------------------------------------------------------------------------*/
+void primes_add_prime_factor(PrimeFactors* factors, uint32 prime) {
+  uint32 i = factors->count++;
+
+  if ((i & ((1U << PRIME_ANCHOR_SHIFT) - 1)) == 0) {
+    factors->anchors[i >> PRIME_ANCHOR_SHIFT] = prime;
+  }
+  factors->gaps[i] = (uint8) ((prime - ((i > 0) ? factors->largest : 5)) / 2);
+  factors->largest = prime;
+}
+
+/*------------------------------------------------------------------------------
+  Ermittelt den Primfaktor mit dem Index i (ab dem letzten Anker davor).
+------------------------------------------------------------------------------*/
+static uint32 prime_factor(const PrimeFactors* factors, uint32 i) {
+  uint32 j = i & ~((1U << PRIME_ANCHOR_SHIFT) - 1);
+  uint32 prime = factors->anchors[j >> PRIME_ANCHOR_SHIFT];
+
+  while (j < i) {
+    prime += 2 * factors->gaps[++j];
+  }
+  return prime;
+}
+
+/*------------------------------------------------------------------------------
+  Zählt die Primfaktoren <= x (binäre Suche in den Ankern, dann entlang der
+  Abstände).
+------------------------------------------------------------------------------*/
+uint32 primes_count_prime_factors_up_to(uint32 x, const PrimeFactors* factors) {
+  uint32 low = 0, high = (factors->count > 0) ? ((factors->count - 1) >> PRIME_ANCHOR_SHIFT) + 1 : 0;
+
+  while (low < high) {
+    uint32 middle = low + (high - low) / 2;
+    if (factors->anchors[middle] <= x) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0) {
+    return 0;
+  }
+
+  uint32 i = (low - 1) << PRIME_ANCHOR_SHIFT;
+  uint64 prime = factors->anchors[low - 1];
+  while (i + 1 < factors->count && prime + 2 * factors->gaps[i + 1] <= x) {
+    prime += 2 * factors->gaps[++i];
+  }
+  return i + 1;
+}
+
+/*------------------------------------------------------------------------------
+  Gibt den Speicher der Primfaktoren wieder frei.
+------------------------------------------------------------------------------*/
+void primes_free_prime_factors(PrimeFactors* factors) {
+  free(factors->gaps);
+  free(factors->anchors);
+}
+
+/*------------------------------------------------------------------------------
+  Baut ein Array für die nächsten Vielfachen der Primfaktoren auf (plus 1 mehr,
+  damit es auch für n < 49 nicht leer ist).
+------------------------------------------------------------------------------*/
+static uint64* build_multiples(uint32 primes_count) {
+  uint64* multiples;
+  size_t multiples_size = sizeof(multiples[0]) * (primes_count + 1);
+  if ((multiples = malloc(multiples_size)) == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  return multiples;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet die Größe eines Siebsegments in Bytes (je 30 Zahlen).
+
+  Die Größe ist unabhängig von n: angefordert oder die Größe des Caches. Sie ist
+  eine Potenz von 2 (>= 8), damit das Sieb wortweise ausgewertet werden kann und
+  die Buckets ohne Division verteilt werden können, und nicht größer als für n
+  nötig.
+------------------------------------------------------------------------------*/
+uint32 primes_calc_sieve_size(uint64 n, uint32 sieve_size_requested) {
+  uint32 sieve_size = (sieve_size_requested > 0) ? sieve_size_requested : detect_cache_size();
+  uint32 power_of_2 = 8;
+
+  while (power_of_2 * 2 <= sieve_size && power_of_2 <= n / 30) {
+    power_of_2 *= 2;
+  }
+  return power_of_2;
+}
+
+/*------------------------------------------------------------------------------
+  Legt ein Siebsegment von sieve_size Bytes an (aus primes_calc_sieve_size).
+
+  Das Segment hat immer diese feste, am Cache ausgerichtete Größe, auch für
+  große n; die Primfaktoren bis sqrt(n) liegen getrennt davon in PrimeFactors.
+------------------------------------------------------------------------------*/
+uint8* primes_build_sieve(uint32 sieve_size) {
+  uint8* sieve;
+  if ((sieve = malloc(sieve_size)) == NULL) {
+    perror("memory error");
+    exit(3);
+  }
+  return sieve;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet alle Primzahlen >= 7 und <= sqrt(n) und hängt sie an die (leeren)
+  Primfaktoren an.
+------------------------------------------------------------------------------*/
+void primes_calc_prime_factors(uint32 sqrts_top, uint32* sqrts, PrimeFactors* factors, uint8* sieve, uint32 sieve_size) {
+  while (sqrts_top > 0) {
+    sqrts_top -= 1;
+
+    uint64 from = sqrts[sqrts_top + 1] + 1ULL;
+    uint64 to = sqrts[sqrts_top];
+    uint32 factors_count = factors->count;
+
+    for (uint64 low_byte = from / 30; low_byte <= to / 30; low_byte += sieve_size) {
+
+      /* Nicht-Primzahlen markieren */
+      sieve_segment(sieve, low_byte, sieve_size, factors, factors_count);
+
+      /* Primzahlen notieren */
+      primes_limit_segment(sieve, low_byte, sieve_size, from, to);
+      store_segment_primes(sieve, low_byte, sieve_size, factors);
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Bereitet das Sieben aufeinanderfolgender Segmente bis höchstens to vor.
+
+  Jeder Primfaktor merkt sich sein nächstes Vielfaches über die Segmente hinweg.
+  Aufgenommen wird er erst, wenn sein Quadrat im aktuellen Segment liegt.
+
+  Große Primfaktoren (> 4 * Segmentgröße) treffen ein Segment höchstens ein paar
+  Mal und die meisten Segmente gar nicht. Sie werden deshalb nach dem Segment
+  ihres nächsten Vielfachen in Buckets einsortiert (Bucket Sieve nach Oliveira e
+  Silva) und nur in diesem Segment angefasst. Liegt das nächste Vielfache hinter
+  to, fällt der Primfaktor ganz heraus; nahe 2^64 trifft so in einem schmalen
+  Bereich nur ein kleiner Teil der Primfaktoren bis 2^32 überhaupt ein Bucket.
+------------------------------------------------------------------------------*/
+void primes_init_segmented_sieve(SegmentedSieve* s, const PrimeFactors* factors, uint32 primes_count, uint32 sieve_size, uint64 to) {
+  uint32 medium_max = (sieve_size < 0x40000000) ? 4 * sieve_size : 0xFFFFFFFF;
+
+  s->factors = factors;
+  s->primes_count = primes_count;
+  s->factors_count = 0;
+  s->next_factor = (primes_count > 0) ? 5 + 2 * factors->gaps[0] : 0;
+  s->sieve_size = sieve_size;
+
+  s->presieved = primes_count_prime_factors_up_to(PRESIEVE_MAX_PRIME, factors);
+  if (s->presieved > primes_count) {
+    s->presieved = primes_count;
+  }
+  s->medium_count = primes_count_prime_factors_up_to(medium_max, factors);
+  if (s->medium_count > primes_count) {
+    s->medium_count = primes_count;
+  }
+
+  /* die mittleren Primfaktoren werden in jedem Segment gebraucht, also als Wert */
+  if ((s->medium_primes = malloc((s->medium_count + 1) * sizeof(uint32))) == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  for (uint32 i = 0, prime = 5; i < s->medium_count; i++) {
+    prime += 2 * factors->gaps[i];
+    s->medium_primes[i] = prime;
+  }
+  s->multiples = build_multiples(s->medium_count);
+  init_bucket_sieve(&s->buckets, (primes_count > 0) ? prime_factor(factors, primes_count - 1) : 0, sieve_size, to);
+}
+
+/*------------------------------------------------------------------------------
+  Siebt das Segment ab dem Byte low_byte, das auf das zuletzt gesiebte folgt
+  (bzw. das erste ist).
+------------------------------------------------------------------------------*/
+void primes_sieve_next_segment(SegmentedSieve* s, uint8* sieve, uint64 low_byte) {
+  uint32 prime = s->next_factor;
+
+  /* neue Primfaktoren aufnehmen */
+  while (s->factors_count < s->primes_count && (uint64) prime * prime / 30 < low_byte + s->sieve_size) {
+    uint64 multiple = first_multiple(prime, low_byte);
+    if (s->factors_count < s->medium_count) {
+      s->multiples[s->factors_count] = multiple;
+    } else {
+      add_to_buckets(&s->buckets, low_byte, prime, multiple);
+    }
+    if (++s->factors_count < s->primes_count) {
+      prime += 2 * s->factors->gaps[s->factors_count];
+    }
+  }
+  s->next_factor = prime;
+
+  /* Nicht-Primzahlen markieren */
+  presieve_segment(sieve, low_byte, s->sieve_size);
+  for (uint32 i = s->presieved; i < s->factors_count && i < s->medium_count; i++) {
+    s->multiples[i] = cross_off_multiples(sieve, low_byte, s->sieve_size, s->medium_primes[i], s->multiples[i]);
+  }
+  cross_off_large_primes(&s->buckets, sieve, low_byte);
+}
+
+/*------------------------------------------------------------------------------
+  Gibt den Speicher für das Sieben aufeinanderfolgender Segmente wieder frei.
+------------------------------------------------------------------------------*/
+void primes_free_segmented_sieve(SegmentedSieve* s) {
+  free(s->medium_primes);
+  free(s->multiples);
+  free_bucket_sieve(&s->buckets);
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet die Tabellen für das Rad modulo 30.
+
+  Für eine Primzahl p = 30 * pq + pr und einen Faktor f = 30 * fq + fr liegt das
+  Vielfache p * f im Byte (p * f) / 30 auf dem Bit für (pr * fr) % 30. Geht man
+  zum nächsten zu 30 teilerfremden Faktor f + g weiter, dann erhöht sich das
+  Byte um pq * g + ((pr * fr) % 30 + pr * g) / 30.
+
+  Die Tabellen werden nur beim ersten Aufruf berechnet, auch wenn mehrere
+  Threads gleichzeitig einen Kontext anlegen.
+------------------------------------------------------------------------------*/
+#ifdef _WIN32
+static BOOL CALLBACK build_wheel_once(PINIT_ONCE once, PVOID parameter, PVOID* context) {
+  build_wheel();
+  return TRUE;
+}
+#endif
+
+void primes_init_wheel(void) {
+#ifdef _WIN32
+  static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+  InitOnceExecuteOnce(&once, build_wheel_once, NULL, NULL);
+#else
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, build_wheel);
+#endif
+}
+
+static void build_wheel(void) {
+  for (uint32 r = 0, k = 0; r < 30; r++) {
+    if (r > wheel_residues[k]) {
+      k += 1;
+    }
+    wheel_index[r] = (uint8) k;
+  }
+  for (uint32 i = 0; i < 8; i++) {
+    for (uint32 k = 0; k < 8; k++) {
+      uint32 r = wheel_residues[i] * wheel_residues[k] % 30;
+      wheel_unset[i][k] = (uint8) ~(1 << wheel_index[r]);
+      wheel_carry[i][k] = (r + wheel_residues[i] * wheel_gaps[k]) / 30;
+    }
+  }
+  for (uint32 b = 0; b < 64; b++) {
+    primes_wheel_offsets[b] = 30 * (b >> 3) + wheel_residues[b & 7];
+  }
+
+  /* Vorsieb: alle Vielfachen ab 1 * p, damit das Muster periodisch ist */
+  memset(presieve_pattern, 0xFF, PRESIEVE_SIZE);
+  for (uint32 i = 1; wheel_residues[i] <= PRESIEVE_MAX_PRIME; i++) {
+    cross_off_multiples(presieve_pattern, 0, PRESIEVE_SIZE, wheel_residues[i], 0);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Füllt ein Segment ab dem Byte low_byte mit dem Vorsieb. Im ersten Segment
+  bleiben die Primzahlen 7 bis 19 selbst erhalten.
+------------------------------------------------------------------------------*/
+static void presieve_segment(uint8* sieve, uint64 low_byte, uint32 size) {
+  uint32 offset = (uint32) (low_byte % PRESIEVE_SIZE);
+
+  for (uint32 pos = 0; pos < size; ) {
+    uint32 length = PRESIEVE_SIZE - offset;
+    if (length > size - pos) {
+      length = size - pos;
+    }
+    memcpy(sieve + pos, presieve_pattern + offset, length);
+    pos += length;
+    offset = 0;
+  }
+  if (low_byte == 0) {
+    sieve[0] = 0xFF;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Siebt ein Segment ab dem Byte low_byte (= Zahl low_byte * 30) mit den
+  ersten primes_count Primfaktoren. Gestrichen wird jeweils ab dem Quadrat.
+------------------------------------------------------------------------------*/
+static void sieve_segment(uint8* sieve, uint64 low_byte, uint32 size, const PrimeFactors* factors, uint32 primes_count) {
+  uint32 prime = 5;
+  memset(sieve, 0xFF, size);
+
+  for (uint32 i = 0; i < primes_count; i++) {
+    prime += 2 * factors->gaps[i];
+    cross_off_multiples(sieve, low_byte, size, prime, first_multiple(prime, low_byte));
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet das erste zu streichende Vielfache einer Primzahl ab dem Byte
+  low_byte, d.h. mit dem kleinsten zu 30 teilerfremden Faktor f >= prime, so dass
+  prime * f >= low_byte * 30 ist.
+
+  Ein Vielfaches wird als Byte * 8 + k dargestellt, wobei k der Index des Rests
+  des Faktors modulo 30 ist. Liegt es jenseits von 2^64, dann ist es (uint64) -1.
+------------------------------------------------------------------------------*/
+static uint64 first_multiple(uint32 prime, uint64 low_byte) {
+  uint64 low = low_byte * 30;
+  uint64 factor = low / prime + (low % prime != 0);
+  if (factor < prime) {
+    factor = prime;
+  }
+  uint32 k = wheel_index[factor % 30];
+  factor += wheel_residues[k] - factor % 30;
+  if (factor > (uint64) -1 / prime) {
+    return (uint64) -1;
+  }
+  return (prime * factor / 30) << 3 | k;
+}
+
+/*------------------------------------------------------------------------------
+  Streicht die Vielfachen einer Primzahl im Segment ab dem Byte low_byte,
+  beginnend bei multiple. Zurückgegeben wird das erste Vielfache danach.
+------------------------------------------------------------------------------*/
+static uint64 cross_off_multiples(uint8* sieve, uint64 low_byte, uint32 size, uint32 prime, uint64 multiple) {
+  uint64 pos = (multiple >> 3) - low_byte;
+  uint32 k = multiple & 7;
+  uint32 pq = prime / 30;
+  uint32 pr = wheel_index[prime % 30];
+
+  while (pos < size) {
+    sieve[pos] &= wheel_unset[pr][k];
+    pos += pq * wheel_gaps[k] + wheel_carry[pr][k];
+    k = (k + 1) & 7;
+  }
+  return (low_byte + pos) << 3 | k;
+}
+
+/*------------------------------------------------------------------------------
+  Baut die Buckets für die großen Primfaktoren auf.
+
+  Ein Vielfaches einer Primzahl p liegt höchstens p / 30 * 6 + 1 Bytes nach dem
+  vorherigen (bzw. beim ersten Vielfachen nach dem Beginn des aktuellen
+  Segments), also höchstens p / Segmentgröße + 1 Segmente weiter. Für so viele
+  Segmente werden Listen von Buckets im Kreis verwaltet. Vielfache > to werden
+  nicht einsortiert.
+------------------------------------------------------------------------------*/
+static void init_bucket_sieve(BucketSieve* buckets, uint32 max_prime, uint32 sieve_size, uint64 to) {
+  uint32 segments_count = 1;
+
+  buckets->sieve_shift = 0;
+  while ((1U << buckets->sieve_shift) < sieve_size) {
+    buckets->sieve_shift += 1;
+  }
+  while (segments_count <= (max_prime >> buckets->sieve_shift) + 1) {
+    segments_count *= 2;
+  }
+
+  if ((buckets->segments = calloc(segments_count, sizeof(buckets->segments[0]))) == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  buckets->segments_mask = segments_count - 1;
+  buckets->segment = 0;
+  buckets->end_byte = to / 30;
+  buckets->free_buckets = NULL;
+}
+
+/*------------------------------------------------------------------------------
+  Sortiert einen großen Primfaktor mit seinem ersten Vielfachen (ab dem Segment,
+  das bei low_byte beginnt) in die Buckets ein.
+------------------------------------------------------------------------------*/
+static void add_to_buckets(BucketSieve* buckets, uint64 low_byte, uint32 prime, uint64 multiple) {
+  if (multiple == (uint64) -1 || (multiple >> 3) > buckets->end_byte) {
+    return;
+  }
+  uint64 pos = (multiple >> 3) - low_byte;
+  uint32 sieve_mask = (1U << buckets->sieve_shift) - 1;
+
+  store_in_bucket(buckets, buckets->segment + (pos >> buckets->sieve_shift),
+                  (prime / 30) << 3 | wheel_index[prime % 30],
+                  (uint32) (pos & sieve_mask) << 3 | (uint32) (multiple & 7));
+}
+
+/*------------------------------------------------------------------------------
+  Legt einen Primfaktor im Bucket des Segments segment ab. Ist dort kein Platz
+  mehr, wird ein freier (oder neuer) Bucket vorne an die Liste angehängt.
+------------------------------------------------------------------------------*/
+static void store_in_bucket(BucketSieve* buckets, uint64 segment, uint32 prime, uint32 index) {
+  Bucket** list = &buckets->segments[segment & buckets->segments_mask];
+  Bucket* bucket = *list;
+
+  if (bucket == NULL || bucket->count == BUCKET_CAPACITY) {
+    if ((bucket = buckets->free_buckets) != NULL) {
+      buckets->free_buckets = bucket->next;
+    } else if ((bucket = malloc(sizeof(Bucket))) == NULL) {
+      perror("memory error");
+      exit(2);
+    }
+    bucket->next = *list;
+    bucket->count = 0;
+    *list = bucket;
+  }
+  bucket->primes[bucket->count].prime = prime;
+  bucket->primes[bucket->count++].index = index;
+}
+
+/*------------------------------------------------------------------------------
+  Streicht im aktuellen Segment die Vielfachen aller großen Primfaktoren, die in
+  seinen Buckets liegen, und sortiert sie danach in die Buckets der Segmente
+  ihrer nächsten Vielfachen ein, sofern diese nicht hinter to liegen. Die
+  geleerten Buckets werden wiederverwendet.
+------------------------------------------------------------------------------*/
+static void cross_off_large_primes(BucketSieve* buckets, uint8* sieve, uint64 low_byte) {
+  Bucket** list = &buckets->segments[buckets->segment & buckets->segments_mask];
+  Bucket* bucket = *list;
+  uint32 sieve_size = 1U << buckets->sieve_shift;
+
+  *list = NULL;
+  while (bucket != NULL) {
+    for (uint32 i = 0; i < bucket->count; i++) {
+      uint32 prime = bucket->primes[i].prime;
+      uint32 pq = prime >> 3;
+      uint32 pr = prime & 7;
+      uint32 pos = bucket->primes[i].index >> 3;
+      uint32 k = bucket->primes[i].index & 7;
+
+      do {
+        sieve[pos] &= wheel_unset[pr][k];
+        pos += pq * wheel_gaps[k] + wheel_carry[pr][k];
+        k = (k + 1) & 7;
+      } while (pos < sieve_size);
+
+      if (low_byte + pos > buckets->end_byte) {
+        continue;
+      }
+      store_in_bucket(buckets, buckets->segment + (pos >> buckets->sieve_shift),
+                      prime, (pos & (sieve_size - 1)) << 3 | k);
+    }
+
+    Bucket* next = bucket->next;
+    bucket->next = buckets->free_buckets;
+    buckets->free_buckets = bucket;
+    bucket = next;
+  }
+  buckets->segment += 1;
+}
+
+/*------------------------------------------------------------------------------
+  Gibt alle Buckets wieder frei.
+------------------------------------------------------------------------------*/
+static void free_bucket_sieve(BucketSieve* buckets) {
+  for (uint32 i = 0; i <= buckets->segments_mask; i++) {
+    while (buckets->segments[i] != NULL) {
+      Bucket* next = buckets->segments[i]->next;
+      free(buckets->segments[i]);
+      buckets->segments[i] = next;
+    }
+  }
+  while (buckets->free_buckets != NULL) {
+    Bucket* next = buckets->free_buckets->next;
+    free(buckets->free_buckets);
+    buckets->free_buckets = next;
+  }
+  free(buckets->segments);
+}
+
+/*------------------------------------------------------------------------------
+  Löscht im Segment alle Bits für Zahlen < from und > to.
+------------------------------------------------------------------------------*/
+void primes_limit_segment(uint8* sieve, uint64 low_byte, uint32 size, uint64 from, uint64 to) {
+  if (from / 30 >= low_byte) {
+    uint64 pos = from / 30 - low_byte;
+    if (pos < size) {
+      memset(sieve, 0, (size_t) pos);
+      sieve[pos] &= (uint8) (0xFF << wheel_index[from % 30]);
+    } else {
+      memset(sieve, 0, size);
+    }
+  }
+  if (to / 30 < low_byte + size) {
+    uint64 pos = to / 30 - low_byte;
+    uint32 r = (uint32) (to % 30);
+    sieve[pos] &= (uint8) ~(0xFF << (wheel_index[r] + (r == wheel_residues[wheel_index[r]])));
+    memset(sieve + pos + 1, 0, (size_t) (size - pos - 1));
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Hängt alle Primzahlen im Segment (alle < 2^32) an die Primfaktoren an.
+------------------------------------------------------------------------------*/
+static void store_segment_primes(uint8* sieve, uint64 low_byte, uint32 size, PrimeFactors* factors) {
+  for (uint32 j = 0; j < size; j += 8) {
+    uint64 word;
+    memcpy(&word, sieve + j, sizeof(word));
+    while (word != 0) {
+      primes_add_prime_factor(factors, (uint32) ((low_byte + j) * 30 + primes_wheel_offsets[ctz64(word)]));
+      word &= word - 1;
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Zählt die Primzahlen im Segment.
+------------------------------------------------------------------------------*/
+CPU_DISPATCH
+uint64 primes_count_segment_primes(uint8* sieve, uint32 size) {
+  uint64 count = 0;
+
+  for (uint32 j = 0; j < size; j += 8) {
+    uint64 word;
+    memcpy(&word, sieve + j, sizeof(word));
+    count += popcount64(word);
+  }
+  return count;
+}
+
+/*------------------------------------------------------------------------------
+  Zählt die Primzahlen im Segment bis einschließlich v.
+------------------------------------------------------------------------------*/
+CPU_DISPATCH
+uint64 primes_count_segment_primes_up_to(uint8* sieve, uint64 low_byte, uint64 v) {
+  uint32 byte = (uint32) (v / 30 - low_byte);
+  uint32 r = (uint32) (v % 30);
+  uint32 pos = byte & ~7U;
+  uint64 count = primes_count_segment_primes(sieve, pos);
+  uint64 word;
+
+  uint32 bits = (byte - pos) * 8 + wheel_index[r] + (r == wheel_residues[wheel_index[r]]);
+  memcpy(&word, sieve + pos, sizeof(word));
+  if (bits < 64) {
+    word &= (1ULL << bits) - 1;
+  }
+  return count + popcount64(word);
+}
+
+
+/*------------------------------------------------------------------------------
+  Ermittelt die erste bzw. letzte Primzahl eines Segments (das eine enthält).
+------------------------------------------------------------------------------*/
+uint64 primes_first_segment_prime(uint8* sieve, uint64 low_byte, uint32 size) {
+  for (uint32 j = 0; j < size; j += 8) {
+    uint64 word;
+    memcpy(&word, sieve + j, sizeof(word));
+    if (word != 0) {
+      return (low_byte + j) * 30 + primes_wheel_offsets[ctz64(word)];
+    }
+  }
+  return 0;
+}
+
+uint64 primes_last_segment_prime(uint8* sieve, uint64 low_byte, uint32 size) {
+  for (uint32 j = size; j > 0; j -= 8) {
+    uint64 word;
+    memcpy(&word, sieve + j - 8, sizeof(word));
+    if (word != 0) {
+      return (low_byte + j - 8) * 30 + primes_wheel_offsets[63 - clz64(word)];
+    }
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+  Ermittelt die n-te Primzahl (n >= 1) im Segment; 0, wenn es weniger gibt.
+------------------------------------------------------------------------------*/
+static uint64 nth_segment_prime(uint8* sieve, uint64 low_byte, uint32 size, uint64 n) {
+  for (uint32 j = 0; j < size; j += 8) {
+    uint64 word;
+    memcpy(&word, sieve + j, sizeof(word));
+    uint64 count = popcount64(word);
+    if (n <= count) {
+      while (--n > 0) {
+        word &= word - 1;
+      }
+      return (low_byte + j) * 30 + primes_wheel_offsets[ctz64(word)];
+    }
+    n -= count;
+  }
+  return 0;
+}
+
+/*==============================================================================
+  Primzahlen zählen (Lagarias, Miller, Odlyzko)
+
+  pi(x) = phi(x, a) + a - 1 - P2(x, a)   mit y ~ x^(1/3) und a = pi(y)
+
+  phi(x, a) ist die Anzahl der Zahlen <= x ohne Primfaktor <= p_a, P2(x, a) die
+  Anzahl der Zahlen <= x mit genau 2 Primfaktoren > p_a. phi(x, a) ergibt sich
+  aus der Summe über die Blätter der Rekursion phi(x, b) = phi(x, b - 1)
+  - phi(x / p_b, b - 1): den gewöhnlichen (n <= y), deren phi(x / n, c) mit
+  einer Tabelle direkt berechnet wird, und den speziellen (n = m * p_b > y),
+  deren phi(x / n, b - 1) beim segmentierten Sieben von [1, x / y] abgezählt
+  wird. P2 wird ebenfalls per Sieb bis x / y abgezählt.
+
+  Die Primzahlen werden hier ab 1 durchnummeriert: lmo_primes[1] = 2.
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Berechnet pi(x), die Anzahl der Primzahlen <= x.
+
+  prime_factors muss alle Primzahlen >= 7 und <= sqrt(x) enthalten.
+------------------------------------------------------------------------------*/
+uint64 primes_count_primes_up_to(uint64 x, const PrimeFactors* prime_factors, uint32 sieve_size) {
+  if (x < 1000) {
+    uint64 count = 0;
+    for (uint32 k = 2; k <= x; k++) {
+      uint32 d = 2;
+      while (d * d <= k && k % d != 0) {
+        d += 1;
+      }
+      count += (d * d > k);
+    }
+    return count;
+  }
+
+  /* y = alpha * x^(1/3); ein größeres alpha verlagert Arbeit vom Sieben bis
+     x / y auf die speziellen Blätter (alpha empirisch ermittelt) */
+  double alpha = log((double) x) / 7;
+  uint64 y = (alpha > 1.0) ? (uint64) (alpha * integer_cube_root(x)) : integer_cube_root(x);
+  uint32 sqrt_x = integer_square_root(x);
+  if (y > sqrt_x) {
+    y = sqrt_x;
+  }
+
+  /* alle Primzahlen <= y, ab 1 nummeriert */
+  uint32 a = 3 + primes_count_prime_factors_up_to((uint32) y, prime_factors);
+  uint32* lmo_primes = malloc((a + 1) * sizeof(uint32));
+  if (lmo_primes == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  lmo_primes[0] = 0;
+  lmo_primes[1] = 2;
+  lmo_primes[2] = 3;
+  lmo_primes[3] = 5;
+  for (uint32 i = 4; i <= a; i++) {
+    lmo_primes[i] = lmo_primes[i - 1] + 2 * prime_factors->gaps[i - 4];
+  }
+
+  uint32 c = (a < PHI_TINY_MAX) ? a : PHI_TINY_MAX;
+  int32* factors = build_factors((uint32) y, a, lmo_primes);
+  uint16* phi_table = build_phi_table(c);
+
+  int64 phi = calc_ordinary_leaves(x, (uint32) y, c, factors, phi_table)
+            + calc_special_leaves(x, (uint32) y, c, a, lmo_primes, factors, phi_table);
+  uint64 p2 = calc_p2(x, (uint32) y, a, prime_factors, sieve_size);
+
+  free(phi_table);
+  free(factors);
+  free(lmo_primes);
+  return (uint64) phi + a - 1 - p2;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet für alle n <= y den kleinsten Primfaktor lpf(n) und die
+  Möbius-Funktion mu(n) und liefert sie zusammen als mu(n) * lpf(n).
+  Für n = 1 ist lpf(n) "unendlich", für nicht quadratfreie n ist das Ergebnis 0.
+------------------------------------------------------------------------------*/
+static int32* build_factors(uint32 y, uint32 a, const uint32* lmo_primes) {
+  int32* factors = calloc(y + 1ULL, sizeof(int32));
+  signed char* mu = malloc(y + 1ULL);
+
+  if (factors == NULL || mu == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  memset(mu, 1, y + 1ULL);
+
+  for (uint32 b = 1; b <= a; b++) {
+    uint32 prime = lmo_primes[b];
+    for (uint32 k = prime; k <= y; k += prime) {
+      if (factors[k] == 0) {
+        factors[k] = (int32) prime;
+      }
+      mu[k] = (signed char) -mu[k];
+    }
+    for (uint64 k = (uint64) prime * prime; k <= y; k += (uint64) prime * prime) {
+      mu[k] = 0;
+    }
+  }
+
+  factors[1] = 0x7FFFFFFF;
+  for (uint32 k = 1; k <= y; k++) {
+    factors[k] *= mu[k];
+  }
+  free(mu);
+  return factors;
+}
+
+/*------------------------------------------------------------------------------
+  Baut die Tabelle für phi(x, c) = (x / p_c#) * phi(p_c#) + phi(x % p_c#, c)
+  auf: table[r] ist die Anzahl der Zahlen in [1, r], die zu p_c# teilerfremd
+  sind.
+------------------------------------------------------------------------------*/
+static uint16* build_phi_table(uint32 c) {
+  uint32 primorial = phi_primorials[c];
+  uint16* table = malloc(primorial * sizeof(uint16));
+
+  if (table == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  table[0] = 0;
+  for (uint32 r = 1; r < primorial; r++) {
+    uint32 coprime = 1;
+    for (uint32 i = 1; i <= c; i++) {
+      coprime &= (r % phi_primes[i] != 0);
+    }
+    table[r] = (uint16) (table[r - 1] + coprime);
+  }
+  return table;
+}
+
+#define phi_tiny(x, c, table) \
+  ((int64) ((x) / phi_primorials[c] * phi_totients[c] + (table)[(x) % phi_primorials[c]]))
+
+/*------------------------------------------------------------------------------
+  Summe der gewöhnlichen Blätter: mu(n) * phi(x / n, c) für alle quadratfreien
+  n <= y, deren Primfaktoren alle > p_c sind.
+------------------------------------------------------------------------------*/
+static int64 calc_ordinary_leaves(uint64 x, uint32 y, uint32 c, const int32* factors, const uint16* phi_table) {
+  int64 sum = 0;
+
+  for (uint32 n = 1; n <= y; n++) {
+    int32 factor = factors[n];
+    if (factor > (int32) phi_primes[c]) {
+      sum += phi_tiny(x / n, c, phi_table);
+    } else if (-factor > (int32) phi_primes[c]) {
+      sum -= phi_tiny(x / n, c, phi_table);
+    }
+  }
+  return sum;
+}
+
+/*------------------------------------------------------------------------------
+  Summe der speziellen Blätter: -mu(m) * phi(x / (m * p_b), b - 1) für alle
+  m <= y < m * p_b mit p_b < lpf(m) und b > c.
+
+  [1, x / y] wird segmentweise (1 Bit je Zahl) gesiebt; nach dem Streichen der
+  Vielfachen von p_1 ... p_(b-1) ist phi(v, b - 1) = phi_b[b] (die Anzahl der
+  übrig gebliebenen Zahlen vor dem Segment) + die Anzahl im Segment bis v.
+  Für letztere gibt es je Block von Zahlen einen Zähler. Da v für ein festes b
+  mit fallendem m wächst, wird ab dem Stand der letzten Abfrage weitergezählt.
+------------------------------------------------------------------------------*/
+CPU_DISPATCH
+static int64 calc_special_leaves(uint64 x, uint32 y, uint32 c, uint32 a, const uint32* lmo_primes, const int32* factors, const uint16* phi_table) {
+  uint64 limit = x / y + 1;
+  uint32 segment_size = 1 << 12;
+  uint32 sqrt_y = integer_square_root(y);
+  uint32 pi_sqrt_y = 0;
+  uint32 primorial = phi_primorials[c];
+  int64 sum = 0;
+  LeafCounter counter;
+
+  while ((uint64) segment_size * segment_size < limit) {
+    segment_size *= 2;
+  }
+  counter.block_shift = 6;
+  while (1U << (2 * counter.block_shift) < segment_size) {
+    counter.block_shift += 1;
+  }
+  while (pi_sqrt_y < a && lmo_primes[pi_sqrt_y + 1] <= sqrt_y) {
+    pi_sqrt_y += 1;
+  }
+
+  uint32 pattern_words = (primorial + segment_size) / 64 + 2;
+  uint64* pattern = calloc(pattern_words, sizeof(uint64));
+  uint64* multiples = malloc((a + 1ULL) * sizeof(uint64));
+  int64* phi_b = calloc(a + 1ULL, sizeof(int64));
+  counter.sieve = malloc(segment_size / 8);
+  counter.counters = malloc((segment_size >> counter.block_shift) * sizeof(uint32));
+  if (   pattern == NULL || multiples == NULL || phi_b == NULL
+      || counter.sieve == NULL || counter.counters == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+
+  /* Muster der zu p_c# teilerfremden Zahlen (ab 0) */
+  for (uint32 i = 0; i < pattern_words * 64; i++) {
+    uint32 r = i % primorial;
+    if (phi_table[r] - (r > 0 ? phi_table[r - 1] : 0)) {
+      pattern[i / 64] |= 1ULL << i % 64;
+    }
+  }
+  for (uint32 b = 1; b <= a; b++) {
+    multiples[b] = lmo_primes[b];
+  }
+
+  for (uint64 low = 1; low < limit; low += segment_size) {
+    uint64 high = (limit - low > segment_size) ? low + segment_size : limit;
+    uint32 size = (uint32) (high - low);
+    uint32 b = c + 1;
+
+    /* die Vielfachen der ersten c Primzahlen streichen */
+    init_leaf_counter(&counter, pattern, (uint32) (low % primorial), size, segment_size);
+
+    /* p_b <= sqrt(y): m beliebig quadratfrei mit lpf(m) > p_b */
+    for (uint32 end = (pi_sqrt_y < a) ? pi_sqrt_y : a; b <= end; b++) {
+      uint64 prime = lmo_primes[b];
+      uint64 x_prime = x / prime;
+      uint64 min_m = x_prime / high;
+      uint64 max_m = x_prime / low;
+      if (min_m < y / prime) {
+        min_m = y / prime;
+      }
+      if (max_m > y) {
+        max_m = y;
+      }
+      if (prime >= max_m) {
+        goto next_segment;
+      }
+      counter.block = 0;
+      counter.sum = 0;
+      for (uint64 m = max_m; m > min_m; m--) {
+        int32 factor = factors[m];
+        if (factor > (int32) prime) {
+          sum -= phi_b[b] + count_leaves(&counter, (uint32) (x_prime / m - low));
+        } else if (-factor > (int32) prime) {
+          sum += phi_b[b] + count_leaves(&counter, (uint32) (x_prime / m - low));
+        }
+      }
+      phi_b[b] += counter.total;
+      cross_off_leaf_multiples(&counter, size, low, (uint32) prime, &multiples[b]);
+    }
+
+    /* p_b > sqrt(y): nur m = p_l (mu = -1) mit p_b < p_l <= y */
+    for (; b < a; b++) {
+      uint64 prime = lmo_primes[b];
+      uint64 x_prime = x / prime;
+      uint64 max_m = x_prime / low;
+      uint64 min_m = x_prime / high;
+      if (max_m > y) {
+        max_m = y;
+      }
+      if (min_m < y / prime) {
+        min_m = y / prime;
+      }
+      if (min_m < prime) {
+        min_m = prime;
+      }
+
+      /* l = pi(max_m) */
+      uint32 l_low = 0;
+      uint32 l_high = a + 1;
+      while (l_high - l_low > 1) {
+        uint32 middle = (l_low + l_high) / 2;
+        if (lmo_primes[middle] <= max_m) {
+          l_low = middle;
+        } else {
+          l_high = middle;
+        }
+      }
+      uint32 l = l_low;
+      if (prime >= lmo_primes[l]) {
+        goto next_segment;
+      }
+      counter.block = 0;
+      counter.sum = 0;
+      for (; lmo_primes[l] > min_m; l--) {
+        sum += phi_b[b] + count_leaves(&counter, (uint32) (x_prime / lmo_primes[l] - low));
+      }
+      phi_b[b] += counter.total;
+      cross_off_leaf_multiples(&counter, size, low, (uint32) prime, &multiples[b]);
+    }
+
+  next_segment:;
+  }
+
+  free(counter.counters);
+  free(counter.sieve);
+  free(phi_b);
+  free(multiples);
+  free(pattern);
+  return sum;
+}
+
+/*------------------------------------------------------------------------------
+  Füllt das Segment (size Bits) mit dem Muster ab Bit offset und baut die Zähler
+  der Blöcke auf.
+------------------------------------------------------------------------------*/
+CPU_DISPATCH
+static void init_leaf_counter(LeafCounter* counter, const uint64* pattern, uint32 offset, uint32 size, uint32 segment_size) {
+  const uint64* source = pattern + offset / 64;
+  uint32 shift = offset % 64;
+  uint32 words = segment_size / 64;
+  uint32 block_words = 1 << (counter->block_shift - 6);
+
+  for (uint32 i = 0; i < words; i++) {
+    counter->sieve[i] = (shift == 0) ? source[i] : source[i] >> shift | source[i + 1] << (64 - shift);
+  }
+  if (size < segment_size) {
+    memset(counter->sieve + (size + 63) / 64, 0, (words - (size + 63) / 64) * sizeof(uint64));
+    if (size % 64 != 0) {
+      counter->sieve[size / 64] &= (1ULL << size % 64) - 1;
+    }
+  }
+
+  counter->total = 0;
+  for (uint32 i = 0; i < words; i += block_words) {
+    uint32 count = 0;
+    for (uint32 j = i; j < i + block_words; j++) {
+      count += (uint32) popcount64(counter->sieve[j]);
+    }
+    counter->counters[i / block_words] = count;
+    counter->total += count;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Anzahl der nicht gestrichenen Zahlen im Segment an den Positionen 0 bis pos.
+  pos darf seit dem Zurücksetzen von block und sum nicht kleiner werden.
+------------------------------------------------------------------------------*/
+CPU_DISPATCH
+static int64 count_leaves(LeafCounter* counter, uint32 pos) {
+  while (((counter->block + 1) << counter->block_shift) <= pos) {
+    counter->sum += counter->counters[counter->block++];
+  }
+
+  int64 count = counter->sum;
+  uint32 i = (counter->block << counter->block_shift) / 64;
+  for (; i < pos / 64; i++) {
+    count += popcount64(counter->sieve[i]);
+  }
+  return count + popcount64(counter->sieve[i] & (~0ULL >> (63 - pos % 64)));
+}
+
+/*------------------------------------------------------------------------------
+  Streicht die ungeraden Vielfachen einer Primzahl ab multiple im Segment ab
+  low und aktualisiert dabei die Zähler.
+------------------------------------------------------------------------------*/
+static void cross_off_leaf_multiples(LeafCounter* counter, uint32 size, uint64 low, uint32 prime, uint64* multiple) {
+  uint64 k = *multiple - low;
+
+  for (; k < size; k += 2ULL * prime) {
+    uint64 bit = 1ULL << k % 64;
+    if (counter->sieve[k / 64] & bit) {
+      counter->sieve[k / 64] &= ~bit;
+      counter->counters[k >> counter->block_shift] -= 1;
+      counter->total -= 1;
+    }
+  }
+  *multiple = low + k;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet P2(x, a) = Summe über y < p_b <= sqrt(x) von pi(x / p_b) - (b - 1).
+
+  Die Werte x / p_b wachsen mit fallendem b; sie werden der Reihe nach beim
+  Sieben von [1, x / y] mit dem Rad-Sieb abgezählt.
+------------------------------------------------------------------------------*/
+CPU_DISPATCH
+static uint64 calc_p2(uint64 x, uint32 y, uint32 a, const PrimeFactors* factors, uint32 sieve_size) {
+  uint64 limit = x / y;
+  uint32 sqrt_x = integer_square_root(x);
+  uint32 sqrt_limit = integer_square_root(limit);
+  uint32 b = 3 + primes_count_prime_factors_up_to(sqrt_x, factors);
+  uint64 sum = 0;
+  uint64 count = 3;   /* 2, 3 und 5 */
+
+  if (b <= a) {
+    return 0;
+  }
+  uint32 p = prime_factor(factors, b - 4);   /* p_b, mit b abwärts entlang der Abstände */
+
+  SegmentedSieve s;
+  uint8* sieve = primes_build_sieve(sieve_size);
+  primes_init_segmented_sieve(&s, factors, primes_count_prime_factors_up_to(sqrt_limit, factors), sieve_size, limit);
+
+  for (uint64 low_byte = 0; b > a; low_byte += sieve_size) {
+    primes_sieve_next_segment(&s, sieve, low_byte);
+    primes_limit_segment(sieve, low_byte, sieve_size, 7, limit);
+
+    uint64 high = (low_byte + sieve_size) * 30;
+    uint32 pos = 0;
+    uint64 word;
+    for (uint64 v; b > a && (v = x / p) < high; p -= 2 * factors->gaps[b - 4], b--) {
+      uint32 byte = (uint32) (v / 30 - low_byte);
+      uint32 r = (uint32) (v % 30);
+      while (pos + 8 <= byte) {
+        memcpy(&word, sieve + pos, sizeof(word));
+        count += popcount64(word);
+        pos += 8;
+      }
+      uint32 bits = (byte - pos) * 8 + wheel_index[r] + (r == wheel_residues[wheel_index[r]]);
+      memcpy(&word, sieve + pos, sizeof(word));
+      if (bits < 64) {
+        word &= (1ULL << bits) - 1;
+      }
+      sum += count + popcount64(word) - (b - 1);
+    }
+    count += primes_count_segment_primes(sieve + pos, sieve_size - pos);
+  }
+
+  primes_free_segmented_sieve(&s);
+  free(sieve);
+  return sum;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet die k-te Primzahl (0 < k <= PI_MAX) mit den Primfaktoren bis
+  sqrt(primes_nth_prime_limit(k)).
+
+  Die Näherung x für die k-te Primzahl (Umkehrung von R(x)) liegt meist um
+  weniger als sqrt(x) / 2 daneben. Ab x - sqrt(x) wird pi genau gezählt (LMO)
+  und dann gesiebt, bis die k-te Primzahl erreicht ist; liegt sie doch
+  darunter, wird der Startpunkt weiter zurückgesetzt.
+------------------------------------------------------------------------------*/
+uint64 primes_find_nth_prime(uint64 k, const PrimeFactors* factors, uint8* sieve, uint32 sieve_size) {
+  if (k <= 3) {
+    return small_primes[k - 1];
+  }
+  uint64 x = approximate_nth_prime(k);
+  uint64 limit = primes_nth_prime_limit(k);
+  uint64 margin = integer_square_root(x) + 1;
+  uint64 from = (x > margin + 6) ? x - margin : 6;  /* pi(6) = 3 < k */
+  uint64 pi_from = primes_count_primes_up_to(from, factors, sieve_size);
+
+  while (pi_from >= k) {
+    margin *= 2;
+    from = (from > margin + 6) ? from - margin : 6;
+    pi_from = primes_count_primes_up_to(from, factors, sieve_size);
+  }
+
+  SegmentedSieve s;
+  uint32 sqrts[5];
+  primes_calc_square_roots(limit, sqrts);
+  primes_init_segmented_sieve(&s, factors, primes_count_prime_factors_up_to(sqrts[0], factors), sieve_size, limit);
+
+  uint64 needed = k - pi_from;
+  uint64 prime = 0;
+  for (uint64 low_byte = (from + 1) / 30; prime == 0 && low_byte <= limit / 30; low_byte += sieve_size) {
+    primes_sieve_next_segment(&s, sieve, low_byte);
+    primes_limit_segment(sieve, low_byte, sieve_size, from + 1, limit);
+    uint64 count = primes_count_segment_primes(sieve, sieve_size);
+    if (count < needed) {
+      needed -= count;
+    } else {
+      prime = nth_segment_prime(sieve, low_byte, sieve_size, needed);
+    }
+  }
+  primes_free_segmented_sieve(&s);
+  return prime;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet eine Schranke, unter der die k-te Primzahl sicher liegt: die
+  Näherung plus den Fehler von li(x) nach Schoenfeld (unter der Riemannschen
+  Vermutung, |pi(x) - li(x)| < sqrt(x) * log(x) / (8 * pi)), als Abstand von
+  Zahlen also mal log(x), dazu ein Faktor 2 Sicherheit.
+------------------------------------------------------------------------------*/
+uint64 primes_nth_prime_limit(uint64 k) {
+  double x = (double) approximate_nth_prime(k);
+  double limit = x + 2 * (sqrt(x) * log(x) * log(x) / (8 * 3.14159265358979) + 1000);
+  return (limit < 18446744073709551615.0) ? (uint64) limit : 18446744073709551615ULL;
+}
+
+/*==============================================================================
+  Primzahltest (Miller-Rabin mit Montgomery-Multiplikation)
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Probedivision durch die Primzahlen bis 47.
+  Zurückgegeben wird 1 (Primzahl), 0 (keine) oder 2 (noch zu prüfen).
+------------------------------------------------------------------------------*/
+static int trial_division(uint64 n) {
+  if (n < 2) {
+    return 0;
+  }
+  for (uint32 i = 0; i < TRIAL_PRIMES_COUNT; i++) {
+    if (n % trial_primes[i] == 0) {
+      return n == trial_primes[i];
+    }
+  }
+  return (n < 53 * 53) ? 1 : 2;
+}
+
+/*------------------------------------------------------------------------------
+  Bereitet die Montgomery-Darstellung modulo n (ungerade) mit R = 2^64 vor.
+  Eine Zahl a wird als a * R mod n dargestellt; R^2 mod n entsteht durch
+  fortgesetztes Verdoppeln von R mod n, ohne 128-Bit-Division.
+------------------------------------------------------------------------------*/
+static void init_montgomery(Montgomery* m, uint64 n) {
+  uint64 inverse = n;  /* stimmt für ungerade n in den untersten 3 Bits */
+
+  for (int i = 0; i < 5; i++) {
+    inverse *= 2 - n * inverse;
+  }
+  m->n = n;
+  m->n_inverse = inverse;
+  m->one = (0 - n) % n;
+  m->minus_one = n - m->one;
+
+  uint64 r2 = m->one;
+  for (int i = 0; i < 64; i++) {
+    r2 = (r2 >= n - r2) ? r2 - (n - r2) : r2 + r2;
+  }
+  m->r2 = r2;
+
+  m->d = n - 1;
+  m->s = 0;
+  while ((m->d & 1) == 0) {
+    m->d >>= 1;
+    m->s += 1;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Führt den Miller-Rabin-Test zur Basis base für mehrere Zahlen (lanes <=
+  MILLER_RABIN_LANES) verschränkt aus: probable[k] = 1, wenn m[k].n den Test
+  besteht.
+
+  a^d wird von links nach rechts über die Bits aller d gemeinsam berechnet; für
+  ein kürzeres d wird solange 1 quadriert. Danach wird quadriert, bis -1
+  erscheint (bestanden) oder s erschöpft ist.
+------------------------------------------------------------------------------*/
+static void miller_rabin_lanes(const Montgomery* m, uint32 lanes, uint64 base, uint8* probable) {
+  uint64 a[MILLER_RABIN_LANES];
+  uint64 x[MILLER_RABIN_LANES];
+  uint64 d_max = 0;
+  uint32 s_max = 0;
+
+  for (uint32 k = 0; k < lanes; k++) {
+    uint64 b = base % m[k].n;
+    a[k] = montgomery_multiply(&m[k], b, m[k].r2);
+    x[k] = m[k].one;
+    probable[k] = (b == 0);  /* n teilt die Basis: nichts zu prüfen */
+    d_max |= m[k].d;
+    s_max = (m[k].s > s_max) ? m[k].s : s_max;
+  }
+
+  for (int bit = 63 - clz64(d_max); bit >= 0; bit--) {
+    for (uint32 k = 0; k < lanes; k++) {
+      x[k] = montgomery_multiply(&m[k], x[k], x[k]);
+    }
+    for (uint32 k = 0; k < lanes; k++) {
+      if ((m[k].d >> bit) & 1) {
+        x[k] = montgomery_multiply(&m[k], x[k], a[k]);
+      }
+    }
+  }
+
+  for (uint32 k = 0; k < lanes; k++) {
+    if (x[k] == m[k].one || x[k] == m[k].minus_one) {
+      probable[k] = 1;
+    }
+  }
+  for (uint32 r = 1; r < s_max; r++) {
+    for (uint32 k = 0; k < lanes; k++) {
+      if (!probable[k] && r < m[k].s) {
+        x[k] = montgomery_multiply(&m[k], x[k], x[k]);
+        probable[k] = (x[k] == m[k].minus_one);
+      }
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet a * b * R^-1 mod n (Montgomery-Reduktion, a, b < n).
+------------------------------------------------------------------------------*/
+static uint64 montgomery_multiply(const Montgomery* m, uint64 a, uint64 b) {
+  uint64 high, mn_high;
+  uint64 low = multiply_64x64(a, b, &high);
+  uint64 q = low * m->n_inverse;
+
+  multiply_64x64(q, m->n, &mn_high);
+  return (high >= mn_high) ? high - mn_high : high - mn_high + m->n;
+}
+
+/*------------------------------------------------------------------------------
+  Multipliziert zwei 64-Bit-Zahlen zu 128 Bit (Rückgabe: untere 64 Bit).
+------------------------------------------------------------------------------*/
+static uint64 multiply_64x64(uint64 a, uint64 b, uint64* high) {
+#ifdef _MSC_VER
+  return _umul128(a, b, high);
+#else
+  unsigned __int128 product = (unsigned __int128) a * b;
+  *high = (uint64) (product >> 64);
+  return (uint64) product;
+#endif
+}
+
+/*==============================================================================
+  allgemeine Funktionen
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Berechnet ISQRT = die ganzzahlige 32-Bit Qudratwurzel einer 64-Bit-Zahl.
+  Es gilt: ISQRT^2 <= x.
+------------------------------------------------------------------------------*/
+static uint32 integer_square_root(uint64 x) {
+  uint32 y = (uint32) sqrt((double) x);
+  return ((uint64) y * (uint64) y <= x) ? y : (y - 1);
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet die ganzzahlige Kubikwurzel einer 64-Bit-Zahl.
+------------------------------------------------------------------------------*/
+static uint32 integer_cube_root(uint64 x) {
+  uint64 y = (uint64) cbrt((double) x);
+  while (y * y * y > x) {
+    y -= 1;
+  }
+  while ((y + 1) * (y + 1) * (y + 1) <= x) {
+    y += 1;
+  }
+  return (uint32) y;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet eine Abschätzung EPRIM für die Anzahl der Primzahlen <= x.
+  Es gilt: EPRIM >= pi(x)
+------------------------------------------------------------------------------*/
+uint32 primes_estimate_number_of_primes_up_to(uint32 x) {
+  return (uint32) (158 + (double) x
+                         / (log(x) - 1.052400915 - (log(4294967295U) - log(x))
+                                                 * 0.08149));
+//return (uint32) (158 + (double) x / (log(x) * 1.08149 - 2.859906955));
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet eine Näherung für pi(x) bis 2^64: die Riemannsche Funktion
+  R(x) = Summe mu(n) / n * li(x^(1/n)), solange x^(1/n) >= 2 ist.
+------------------------------------------------------------------------------*/
+static double approximate_pi(double x) {
+  double sum = 0;
+
+  for (uint32 n = 1; pow(x, 1.0 / n) >= 2; n++) {
+    sum += moebius(n) * logarithmic_integral(pow(x, 1.0 / n)) / n;
+  }
+  return sum;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet eine Näherung für die k-te Primzahl: R(x) = k wird per
+  Newton-Verfahren mit R'(x) ~ 1 / log(x) gelöst, ausgehend von
+  k * (log(k) + log(log(k)) - 1).
+------------------------------------------------------------------------------*/
+static uint64 approximate_nth_prime(uint64 k) {
+  if (k <= 3) {
+    return small_primes[k - 1];
+  }
+  double x = k * (log((double) k) + log(log((double) k)) - 1);
+
+  for (int i = 0; i < 50; i++) {
+    double step = (approximate_pi(x) - k) * log(x);
+    x -= step;
+    if (x < 7) {
+      x = 7;
+    }
+    if (fabs(step) < 1) {
+      break;
+    }
+  }
+  return (x < 18446744073709551615.0) ? (uint64) x : 18446744073709551615ULL;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet den Integrallogarithmus li(x) (x > 1) mit der Reihe von Ramanujan:
+  li(x) = gamma + log(log(x)) + sqrt(x) * Summe (-1)^(n-1) * log(x)^n
+          / (n! * 2^(n-1)) * Summe(k = 0 .. (n-1)/2) 1 / (2k+1)
+------------------------------------------------------------------------------*/
+static double logarithmic_integral(double x) {
+  double log_x = log(x);
+  double sum = 0;
+  double term = 1;        /* (-1)^(n-1) * log(x)^n / (n! * 2^(n-1)) */
+  double inner = 0;
+
+  for (uint32 n = 1; n < 1000; n++) {
+    term *= (n == 1) ? log_x : -log_x / (2.0 * n);
+    if (n % 2 == 1) {
+      inner += 1.0 / n;
+    }
+    sum += term * inner;
+    if (fabs(term * inner) < 1e-17 * fabs(sum)) {
+      break;
+    }
+  }
+  return 0.57721566490153286 + log(log_x) + sqrt(x) * sum;
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet die Möbius-Funktion mu(n).
+------------------------------------------------------------------------------*/
+static int moebius(uint32 n) {
+  int mu = 1;
+
+  for (uint32 d = 2; d * d <= n; d++) {
+    if (n % d == 0) {
+      n /= d;
+      if (n % d == 0) {
+        return 0;
+      }
+      mu = -mu;
+    }
+  }
+  return (n > 1) ? -mu : mu;
+}
+
+/*------------------------------------------------------------------------------
+  Ermittelt die Größe des L2-Caches (bzw. des L1-Daten-Caches) eines Kerns.
+  Wenn beides nicht ermittelt werden kann, wird 256 KiB angenommen.
+------------------------------------------------------------------------------*/
+static uint32 detect_cache_size(void) {
+  long long cache_size = 0;
+#ifdef _WIN32
+  SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info;
+  DWORD info_size = 0;
+
+  GetLogicalProcessorInformation(NULL, &info_size);
+  if ((info = malloc(info_size)) != NULL && GetLogicalProcessorInformation(info, &info_size)) {
+    for (DWORD i = 0; i < info_size / sizeof(info[0]); i++) {
+      if (   info[i].Relationship == RelationCache
+          && (   info[i].Cache.Level == 2
+              || info[i].Cache.Level == 1 && info[i].Cache.Type != CacheInstruction && cache_size == 0)) {
+        cache_size = info[i].Cache.Size;
+      }
+    }
+  }
+  free(info);
+#else
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  cache_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  if (cache_size <= 0) {
+    cache_size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+  }
+#endif
+#endif
+  if (cache_size <= 0 || cache_size > 1024 * 1024 * 1024) {
+    cache_size = 256 * 1024;
+  }
+  return (uint32) cache_size;
+}
@@ -0,0 +1,57 @@
+/*------------------------------------------------------------------------------
+  L I B P R I M E S . H
+
+  Berechnung der Primzahlen zwischen from und to (< 2^64) als Bibliothek
+
+  Ein Kontext siebt seinen Bereich Segment für Segment und hat keinen Zustand
+  mit anderen Kontexten gemeinsam; mehrere Threads können also gleichzeitig je
+  einen eigenen Kontext verwenden.
+
+    PrimesContext* ctx = primes_create(from, to, 0);
+    uint64_t prime;
+    while (primes_next(ctx, &prime)) {
+      ...
+    }
+    primes_destroy(ctx);
+
+  primes_next liefert die Primzahlen einzeln aus dem Segment im Kontext.
+  primes_generate übergibt sie statt dessen segmentweise als Array an eine
+  Callback-Funktion, bis diese einen Wert != 0 zurückgibt; beides kann gemischt
+  werden. primes_pi berechnet die Anzahl der Primzahlen <= x, ohne sie alle zu
+  sieben, primes_nth umgekehrt die k-te Primzahl. primes_is_prime bzw.
+  primes_is_prime_batch prüfen einzelne Zahlen ohne Sieb (deterministischer
+  Miller-Rabin-Test).
+
+  Bei Speichermangel wird wie im Programm primes mit einer Meldung abgebrochen.
+
+  Die interne Schnittstelle des Siebs, auf der primes.c aufsetzt, steht in
+  libprimes-internal.h; sie gehört nicht zur Bibliothek.
+
+  Compile: cc -O2 -c libprimes.c && ar rcs libprimes.a libprimes.o
+     oder: cl /nologo /O2 /c libprimes.c && lib /nologo libprimes.obj
+------------------------------------------------------------------------------*/
+#ifndef LIBPRIMES_H
+#define LIBPRIMES_H
+
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+  Datentypen
+------------------------------------------------------------------------------*/
+typedef struct PrimesContext PrimesContext;
+
+typedef int (*PrimesCallback)(const uint64_t* primes, uint32_t count, void* user_data);
+
+/*------------------------------------------------------------------------------
+  Schnittstelle
+------------------------------------------------------------------------------*/
+PrimesContext* primes_create(uint64_t from, uint64_t to, uint32_t sieve_size);
+int primes_next(PrimesContext* ctx, uint64_t* prime);
+uint64_t primes_generate(PrimesContext* ctx, PrimesCallback callback, void* user_data);
+void primes_destroy(PrimesContext* ctx);
+uint64_t primes_pi(uint64_t x);
+uint64_t primes_nth(uint64_t k);
+int primes_is_prime(uint64_t n);
+void primes_is_prime_batch(const uint64_t* numbers, uint32_t count, uint8_t* results);
+
+#endif
@@ -6,7 +6,17 @@
   Wenn nur ein Argument (n) angegeben wird, dann werden alle Primzahlen zwischen
   1 und n ausgegeben.
 
-  Aufruf: primes [Von-Zahl (> 0)] Bis-Zahl (> 0)
+  Aufruf: primes [--count] [--checkpoint Datei [--resume]]
+                 [Von-Zahl (> 0)] Bis-Zahl (> 0)
+
+  Mit --count (oder -c) werden die Primzahlen nur gezählt; ausgegeben werden
+  deren Anzahl sowie die erste und letzte Primzahl mit ihrer Nummer.
+
+  Mit --checkpoint wird etwa jede Minute zu Beginn einer Runde im Ring der
+  Stand in die Datei geschrieben: die Zahl, die Zähler, die Länge der Ausgabe,
+  der Ring und die Faktoren in den Buckets. Mit --resume wird ein abgebrochener
+  Lauf dort fortgesetzt; die Ausgabe (eine Datei, mit ">>" oder "1<>"
+  umgeleitet) wird dafür auf den Stand des Checkpoints gekürzt.
 
   Compile: cc -O2 -o primes primes.c -lm
      oder: cl /nologo /O2 /Fe: primes.exe primes.c
@@ -16,6 +26,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 
 /*------------------------------------------------------------------------------
  Datentypen
@@ -26,11 +45,32 @@ typedef unsigned int           uint32;
 typedef struct {
   uint64 n_start;
   uint64 n;
+  int    count_only;
+  const char* checkpoint_file;
+  int    resume;
 } Parameters;
 
 typedef struct {
-  uint64  width_mask;
-  uint32* data;
+  uint32 factor;
+  uint32 offset;   /* Platz im Ring in der Runde des Buckets */
+} Overflow;
+
+#define BUCKET_CAPACITY 1023
+
+typedef struct Bucket {
+  struct Bucket* next;
+  uint32         count;
+  Overflow       factors[BUCKET_CAPACITY];
+} Bucket;
+
+typedef struct {
+  uint64   width_mask;
+  uint32   width_shift;    /* log2 der Breite des Rings */
+  uint32*  data;
+  uint64   round;          /* Anzahl der bisherigen Umläufe im Ring */
+  Bucket** rounds;         /* je kommender Runde eine Liste von Buckets */
+  uint64   rounds_mask;
+  Bucket*  free_buckets;
 } Sieve;
 
 /*------------------------------------------------------------------------------
@@ -39,8 +79,16 @@ typedef struct {
 Parameters get_parameters(int argc, char** argv);
 void print_primes(uint64 n);
 void print_prime(uint64 prime_number);
+void print_count(void);
 Sieve build_sieve(uint32 sqrt_n);
-void sieve_primes(uint64 n, uint32 sqrt_n, uint64 sieve_width_mask, uint32* sieve_data);
+void sieve_primes(uint64 from, uint64 n, uint32 sqrt_n, Sieve* sieve);
+void insert_factor(Sieve* sieve, uint64 i, uint64 distance, uint32 factor);
+void store_overflow(Sieve* sieve, uint64 position, uint32 factor);
+void next_round(Sieve* sieve);
+void free_sieve(Sieve* sieve);
+uint64 resume_checkpoint(Sieve* sieve);
+void save_checkpoint(const Sieve* sieve, uint64 number);
+void checkpoint_error(const char* file_name);
 uint64 atoul(const char* s);
 uint32 integer_square_root(uint64 x);
 uint64 round_up_to_next_power_of_2(uint64 x);
@@ -49,19 +97,44 @@ uint64 round_up_to_next_power_of_2(uint64 x);
   globale Variablen
 ------------------------------------------------------------------------------*/
 uint64 n_start;
+int    count_only;
+uint64 primes_count;  /* Anzahl der bisher gefundenen Primzahlen */
+uint64 first_serial;  /* Nummer und Wert der ersten Primzahl >= n_start */
+uint64 first_prime;
+uint64 last_prime;
+uint64 output_written;  /* Anzahl der ausgegebenen Bytes */
+uint64 n_end;
+const char* checkpoint_file;
+int    resume;
+time_t checkpoint_due;  /* Zeit des nächsten Checkpoints */
 
 /*------------------------------------------------------------------------------
   Macros
 ------------------------------------------------------------------------------*/
 #define odd(n) ((n - 1) | 1)
 
+#define RING_WIDTH_MAX (1U << 17)  /* 512 KB, passt in den L2-Cache */
+
+#define CHECKPOINT_INTERVAL 60     /* Sekunden */
+#define CHECKPOINT_VALUES   10     /* Kopf: "PRIMECK1" und 10 uint64 */
+
 /*------------------------------------------------------------------------------
   Beginn der Verarbeitung
 ------------------------------------------------------------------------------*/
 int main(int argc, char* argv[]) {
   Parameters p = get_parameters(argc, argv);
   n_start = p.n_start;
+  n_end = p.n;
+  count_only = p.count_only;
+  checkpoint_file = p.checkpoint_file;
+  resume = p.resume;
   print_primes(p.n);
+  if (count_only) {
+    print_count();
+  }
+  if (checkpoint_file != NULL) {
+    remove(checkpoint_file);
+  }
   return 0;
 }
 
@@ -71,11 +144,30 @@ int main(int argc, char* argv[]) {
 Parameters get_parameters(int argc, char** argv) {
   Parameters p;
 
+  p.count_only = 0;
+  p.checkpoint_file = NULL;
+  p.resume = 0;
+  while (argc > 1 && argv[1][0] == '-') {
+    if (strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "--count") == 0) {
+      p.count_only = 1;
+    } else if (strcmp(argv[1], "--resume") == 0) {
+      p.resume = 1;
+    } else if (strcmp(argv[1], "--checkpoint") == 0 && argc > 2) {
+      p.checkpoint_file = argv[2];
+      argc -= 1;
+      argv += 1;
+    } else {
+      break;
+    }
+    argc -= 1;
+    argv += 1;
+  }
   if (   argc != 2 && argc != 3
+      || p.resume && p.checkpoint_file == NULL
       || argc == 2 && (   (p.n_start = 1, p.n = atoul(argv[1])) < 1)
       || argc == 3 && (   (p.n_start =          atoul(argv[1])) < 1
                        || (               p.n = atoul(argv[2])) < 1)) {
-    fprintf(stderr, "usage: primes2 [From-Number (in (0,2^64))] To-Number (in (0..2^64))\n");
+    fprintf(stderr, "usage: primes2 [--count] [--checkpoint File [--resume]] [From-Number (in (0,2^64))] To-Number (in (0..2^64))\n");
     exit(1);
   }
   return p;
@@ -85,10 +177,15 @@ Parameters get_parameters(int argc, char** argv) {
   Gibt alle Primzahlen <= n aus.
 ------------------------------------------------------------------------------*/
 void print_primes(uint64 n) {
-  print_prime(2);
   uint32 sqrt_n = odd(integer_square_root(n));
   Sieve sieve = build_sieve(sqrt_n);
-  sieve_primes(n, sqrt_n, sieve.width_mask, sieve.data);
+  uint64 from = resume_checkpoint(&sieve);
+  if (from == 0) {
+    print_prime(2);
+    from = 3;
+  }
+  sieve_primes(from, n, sqrt_n, &sieve);
+  free_sieve(&sieve);
 }
 
 /*------------------------------------------------------------------------------
@@ -97,43 +194,86 @@ void print_primes(uint64 n) {
   Primzahlen < n_start werden nicht ausgegeben.
 ------------------------------------------------------------------------------*/
 void print_prime(uint64 prime_number) {
-  static uint64 primes_count = 0;
   primes_count += 1;
   if (prime_number >= n_start) {
-    printf("%llu. prime = %llu\n", primes_count, prime_number);
+    if (count_only) {
+      if (first_serial == 0) {
+        first_serial = primes_count;
+        first_prime = prime_number;
+      }
+      last_prime = prime_number;
+    } else {
+      output_written += printf("%llu. prime = %llu\n", primes_count, prime_number);
+    }
   }
 }
 
 /*------------------------------------------------------------------------------
-  Baut ein Sieb auf, das ausreichend gro und mit Nullen initialisiert ist.
+  Gibt die Anzahl der Primzahlen >= n_start und die erste und letzte aus.
+------------------------------------------------------------------------------*/
+void print_count(void) {
+  if (first_serial == 0) {
+    printf("0 primes\n");
+    return;
+  }
+  printf("%llu primes\n", primes_count - first_serial + 1);
+  printf("first: %llu. prime = %llu\n", first_serial, first_prime);
+  printf("last: %llu. prime = %llu\n", primes_count, last_prime);
+}
 
-  Speicher wird in einer Grenordnung von 2 mal der Wurzel von n bentigt.
+/*------------------------------------------------------------------------------
+  Baut ein Sieb auf, das ausreichend groß und mit Nullen initialisiert ist.
+
+  Der Ring ist 2 mal die Wurzel von n breit, höchstens aber RING_WIDTH_MAX
+  Einträge. Faktoren, deren nächstes Vielfaches nicht mehr in den Ring passt,
+  warten in Buckets auf die Runde, in der der Ring dort angekommen ist. Außer
+  dem Ring wird also nur Speicher für die Primfaktoren selbst benötigt.
 ------------------------------------------------------------------------------*/
 Sieve build_sieve(uint32 sqrt_n) {
   Sieve sieve;
 
   uint64 sieve_width = round_up_to_next_power_of_2((uint64) sqrt_n * 2);
-  uint64 sieve_size = sieve_width * sizeof(sieve.data[0]);
+  if (sieve_width > RING_WIDTH_MAX) {
+    sieve_width = RING_WIDTH_MAX;
+  }
   sieve.width_mask = sieve_width - 1;
+  sieve.width_shift = 0;
+  while ((1ULL << sieve.width_shift) < sieve_width) {
+    sieve.width_shift += 1;
+  }
+
+  /* ein Faktor landet höchstens sqrt_n + sieve_width Plätze voraus */
+  uint64 rounds = round_up_to_next_power_of_2(sqrt_n / sieve_width + 3);
+  sieve.rounds_mask = rounds - 1;
+  sieve.round = 0;
+  sieve.free_buckets = NULL;
 
-  if (   sieve_size > (size_t) sieve_size && (errno = ENOMEM)
-      || (sieve.data = malloc((size_t) sieve_size)) == NULL) {
+  if (   (sieve.data = calloc((size_t) sieve_width, sizeof(sieve.data[0]))) == NULL
+      || (sieve.rounds = calloc((size_t) rounds, sizeof(sieve.rounds[0]))) == NULL) {
     perror("memory error");
     exit(2);
   }
-  memset(sieve.data, 0, (size_t) sieve_size);
   return sieve;
 }
 
 /*------------------------------------------------------------------------------
-  Berechnet mit dem Algorithmus des Eratosthenes alle Primzahlen ab 3 bis n und
-  gibt sie aus.
+  Berechnet mit dem Algorithmus des Eratosthenes alle Primzahlen ab from (3
+  oder der Zahl eines Checkpoints) bis n und gibt sie aus. Die Zahl number
+  liegt im Ring auf Platz (number - 1) / 2.
 ------------------------------------------------------------------------------*/
-void sieve_primes(uint64 n, uint32 sqrt_n, uint64 sieve_width_mask, uint32* sieve_data) {
-  uint64 i = 0;
+void sieve_primes(uint64 from, uint64 n, uint32 sqrt_n, Sieve* sieve) {
+  uint32* sieve_data = sieve->data;
+  uint64  sieve_width_mask = sieve->width_mask;
+  uint64  i = ((from - 3) / 2) & sieve_width_mask;
 
-  for (uint64 number = 3; number <= n; number += 2) {
+  for (uint64 number = from; number <= n; number += 2) {
     i = (i + 1) & sieve_width_mask;
+    if (i == 0) {
+      if (checkpoint_file != NULL) {
+        save_checkpoint(sieve, number);
+      }
+      next_round(sieve);
+    }
     uint32 factor;
     if (sieve_data[i] == 0) {
       print_prime(number);
@@ -146,10 +286,16 @@ void sieve_primes(uint64 n, uint32 sqrt_n, uint64 sieve_width_mask, uint32* siev
       sieve_data[i] = 0;
     }
 
-    uint64 j = i;
+    uint64 distance = 0;
     do {
-      j = (j + factor) & sieve_width_mask;
+      distance += factor;
+      if (distance > sieve_width_mask) {
+        store_overflow(sieve, (sieve->round << sieve->width_shift) + i + distance, factor);
+        break;
+      }
+      uint64 j = (i + distance) & sieve_width_mask;
       if (sieve_data[j] == 0) {
+        sieve_data[j] = factor;
         break;
       }
       if (sieve_data[j] < factor) {
@@ -158,10 +304,273 @@ void sieve_primes(uint64 n, uint32 sqrt_n, uint64 sieve_width_mask, uint32* siev
         factor = smaller_factor;
       }
     } while (1);
-    sieve_data[j] = factor;
   }
 }
 
+/*------------------------------------------------------------------------------
+  Legt einen Faktor distance Plätze hinter dem Platz i im Ring ab. Ist der
+  Platz belegt, geht der größere der beiden Faktoren zu seinem nächsten
+  Vielfachen weiter. Liegt das nicht mehr im Ring, kommt er in einen Bucket.
+------------------------------------------------------------------------------*/
+void insert_factor(Sieve* sieve, uint64 i, uint64 distance, uint32 factor) {
+  uint32* sieve_data = sieve->data;
+  uint64  sieve_width_mask = sieve->width_mask;
+
+  do {
+    if (distance > sieve_width_mask) {
+      store_overflow(sieve, (sieve->round << sieve->width_shift) + i + distance, factor);
+      return;
+    }
+    uint64 j = (i + distance) & sieve_width_mask;
+    if (sieve_data[j] == 0) {
+      sieve_data[j] = factor;
+      return;
+    }
+    if (sieve_data[j] < factor) {
+      uint32 smaller_factor = sieve_data[j];
+      sieve_data[j] = factor;
+      factor = smaller_factor;
+    }
+    distance += factor;
+  } while (1);
+}
+
+/*------------------------------------------------------------------------------
+  Legt einen Faktor für den (absoluten) Platz position im Bucket der Runde ab,
+  in der der Ring dort ankommt.
+------------------------------------------------------------------------------*/
+void store_overflow(Sieve* sieve, uint64 position, uint32 factor) {
+  Bucket** list = &sieve->rounds[(position >> sieve->width_shift) & sieve->rounds_mask];
+  Bucket* bucket = *list;
+
+  if (bucket == NULL || bucket->count == BUCKET_CAPACITY) {
+    if ((bucket = sieve->free_buckets) != NULL) {
+      sieve->free_buckets = bucket->next;
+    } else if ((bucket = malloc(sizeof(Bucket))) == NULL) {
+      perror("memory error");
+      exit(2);
+    }
+    bucket->next = *list;
+    bucket->count = 0;
+    *list = bucket;
+  }
+  bucket->factors[bucket->count].factor = factor;
+  bucket->factors[bucket->count++].offset = (uint32) (position & sieve->width_mask);
+}
+
+/*------------------------------------------------------------------------------
+  Beginnt eine neue Runde im Ring und legt die Faktoren aus deren Buckets an
+  ihren Platz. Die geleerten Buckets werden wiederverwendet.
+------------------------------------------------------------------------------*/
+void next_round(Sieve* sieve) {
+  sieve->round += 1;
+  Bucket** list = &sieve->rounds[sieve->round & sieve->rounds_mask];
+  Bucket* bucket = *list;
+
+  *list = NULL;
+  while (bucket != NULL) {
+    for (uint32 k = 0; k < bucket->count; k++) {
+      insert_factor(sieve, 0, bucket->factors[k].offset, bucket->factors[k].factor);
+    }
+
+    Bucket* next = bucket->next;
+    bucket->next = sieve->free_buckets;
+    sieve->free_buckets = bucket;
+    bucket = next;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Gibt den Ring und alle Buckets wieder frei.
+------------------------------------------------------------------------------*/
+void free_sieve(Sieve* sieve) {
+  for (uint64 r = 0; r <= sieve->rounds_mask; r++) {
+    while (sieve->rounds[r] != NULL) {
+      Bucket* next = sieve->rounds[r]->next;
+      free(sieve->rounds[r]);
+      sieve->rounds[r] = next;
+    }
+  }
+  while (sieve->free_buckets != NULL) {
+    Bucket* next = sieve->free_buckets->next;
+    free(sieve->free_buckets);
+    sieve->free_buckets = next;
+  }
+  free(sieve->rounds);
+  free(sieve->data);
+}
+
+/*==============================================================================
+  Checkpoints (--checkpoint, --resume)
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Bereitet die Checkpoints vor. Mit --resume werden die Zähler, der Ring und die
+  Buckets aus dem Checkpoint übernommen und die Ausgabe auf dessen Stand
+  gekürzt (ohne Checkpoint: geleert).
+  Zurückgegeben wird die Zahl, bei der es weitergeht; 0: von vorn.
+------------------------------------------------------------------------------*/
+uint64 resume_checkpoint(Sieve* sieve) {
+  uint64 values[CHECKPOINT_VALUES];
+  char magic[8];
+  uint64 number = 0;
+
+  if (checkpoint_file == NULL) {
+    return 0;
+  }
+  checkpoint_due = time(NULL) + CHECKPOINT_INTERVAL;
+#ifdef _WIN32
+  int fd = _fileno(stdout);
+  struct _stat64 st;
+  if (!count_only && (_fstat64(fd, &st) != 0 || (st.st_mode & _S_IFMT) != _S_IFREG)) {
+#else
+  int fd = fileno(stdout);
+  struct stat st;
+  if (!count_only && (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))) {
+#endif
+    fprintf(stderr, "%s: the output must be a regular file\n", checkpoint_file);
+    exit(3);
+  }
+  if (!resume) {
+    return 0;
+  }
+
+  FILE* file = fopen(checkpoint_file, "rb");
+  if (file == NULL && errno != ENOENT) {
+    checkpoint_error(checkpoint_file);
+  }
+  if (file != NULL) {
+    if (   fread(magic, 1, 8, file) != 8 || memcmp(magic, "PRIMECK1", 8) != 0
+        || fread(values, sizeof(uint64), CHECKPOINT_VALUES, file) != CHECKPOINT_VALUES) {
+      fprintf(stderr, "%s: not a checkpoint of primes-alternative-1\n", checkpoint_file);
+      exit(3);
+    }
+    if (values[0] != n_start || values[1] != n_end || values[2] != (uint64) count_only) {
+      fprintf(stderr, "%s: checkpoint of another range or format\n", checkpoint_file);
+      exit(3);
+    }
+    number = values[3];
+    primes_count = values[4];
+    first_serial = values[5];
+    first_prime = values[6];
+    last_prime = values[7];
+    output_written = values[8];
+    sieve->round = values[9];
+
+    uint64 width = sieve->width_mask + 1;
+    if (fread(sieve->data, sizeof(uint32), (size_t) width, file) != width) {
+      fprintf(stderr, "%s: truncated checkpoint\n", checkpoint_file);
+      exit(3);
+    }
+    for (uint64 r = 0; r <= sieve->rounds_mask; r++) {
+      uint64 count;
+      Overflow overflow;
+      if (fread(&count, sizeof(count), 1, file) != 1) {
+        fprintf(stderr, "%s: truncated checkpoint\n", checkpoint_file);
+        exit(3);
+      }
+      for (uint64 k = 0; k < count; k++) {
+        if (fread(&overflow, sizeof(overflow), 1, file) != 1) {
+          fprintf(stderr, "%s: truncated checkpoint\n", checkpoint_file);
+          exit(3);
+        }
+        store_overflow(sieve, (r << sieve->width_shift) + overflow.offset, overflow.factor);
+      }
+    }
+    fclose(file);
+  }
+
+  if (count_only) {
+    return number;
+  }
+  if ((uint64) st.st_size < output_written) {
+    fprintf(stderr, "%s: the output is shorter than at the checkpoint\n", checkpoint_file);
+    exit(3);
+  }
+#ifdef _WIN32
+  if (_chsize_s(fd, output_written) != 0 || _fseeki64(stdout, output_written, SEEK_SET) != 0) {
+#else
+  if (ftruncate(fd, (off_t) output_written) != 0 || fseeko(stdout, (off_t) output_written, SEEK_SET) != 0) {
+#endif
+    perror("output error");
+    exit(3);
+  }
+  return number;
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt einen Checkpoint, sofern der nächste fällig ist; number ist die
+  nächste Zahl, der Ring steht am Ende einer Runde.
+
+  Die Ausgabe kommt vorher auf die Platte, der Checkpoint als temporäre Datei,
+  die dann umbenannt wird: es gibt also immer einen vollständigen.
+------------------------------------------------------------------------------*/
+void save_checkpoint(const Sieve* sieve, uint64 number) {
+  if (time(NULL) < checkpoint_due) {
+    return;
+  }
+#ifdef _WIN32
+  if (fflush(stdout) != 0 || !count_only && _commit(_fileno(stdout)) != 0) {
+#else
+  if (fflush(stdout) != 0 || !count_only && fsync(fileno(stdout)) != 0) {
+#endif
+    perror("output error");
+    exit(3);
+  }
+
+  char temp_name[4096];
+  if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", checkpoint_file) >= (int) sizeof(temp_name)) {
+    fprintf(stderr, "%s: file name too long\n", checkpoint_file);
+    exit(3);
+  }
+  uint64 values[CHECKPOINT_VALUES] = {
+    n_start, n_end, (uint64) count_only, number, primes_count,
+    first_serial, first_prime, last_prime, output_written, sieve->round
+  };
+  uint64 width = sieve->width_mask + 1;
+  FILE* file = fopen(temp_name, "wb");
+  if (   file == NULL
+      || fwrite("PRIMECK1", 1, 8, file) != 8
+      || fwrite(values, sizeof(uint64), CHECKPOINT_VALUES, file) != CHECKPOINT_VALUES
+      || fwrite(sieve->data, sizeof(uint32), (size_t) width, file) != width) {
+    checkpoint_error(temp_name);
+  }
+  for (uint64 r = 0; r <= sieve->rounds_mask; r++) {
+    uint64 count = 0;
+    for (Bucket* bucket = sieve->rounds[r]; bucket != NULL; bucket = bucket->next) {
+      count += bucket->count;
+    }
+    if (fwrite(&count, sizeof(count), 1, file) != 1) {
+      checkpoint_error(temp_name);
+    }
+    for (Bucket* bucket = sieve->rounds[r]; bucket != NULL; bucket = bucket->next) {
+      if (fwrite(bucket->factors, sizeof(Overflow), bucket->count, file) != bucket->count) {
+        checkpoint_error(temp_name);
+      }
+    }
+  }
+#ifdef _WIN32
+  if (fflush(file) != 0 || _commit(_fileno(file)) != 0 || fclose(file) != 0) {
+#else
+  if (fflush(file) != 0 || fsync(fileno(file)) != 0 || fclose(file) != 0) {
+#endif
+    checkpoint_error(temp_name);
+  }
+#ifdef _WIN32
+  if (!MoveFileExA(temp_name, checkpoint_file, MOVEFILE_REPLACE_EXISTING)) {
+#else
+  if (rename(temp_name, checkpoint_file) != 0) {
+#endif
+    checkpoint_error(checkpoint_file);
+  }
+  checkpoint_due = time(NULL) + CHECKPOINT_INTERVAL;
+}
+
+void checkpoint_error(const char* file_name) {
+  perror(file_name);
+  exit(3);
+}
+
 /*==============================================================================
   allgemeine Funktionen
 ==============================================================================*/
@@ -193,7 +602,7 @@ uint32 integer_square_root(uint64 x) {
 }
 
 /*------------------------------------------------------------------------------
-  Rundet zur nchsten Potenz von 2 auf.
+  Rundet zur nächsten Potenz von 2 auf.
 ------------------------------------------------------------------------------*/
 uint64 round_up_to_next_power_of_2(uint64 x) {
   x -= 1;
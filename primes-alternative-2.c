@@ -6,24 +6,45 @@
   Wenn nur ein Argument (n) angegeben wird, dann werden alle Primzahlen zwischen
   1 und n ausgegeben.
 
-  Aufruf: primes [Von-Zahl (> 0)] Bis-Zahl (> 0)
+  Aufruf: primes [--count] [--checkpoint Datei [--resume]]
+                 [Von-Zahl (> 0)] Bis-Zahl (> 0)
+
+  Mit --count (oder -c) werden die Primzahlen nur gezählt; ausgegeben werden
+  deren Anzahl sowie die erste und letzte Primzahl mit ihrer Nummer.
+
+  Mit --checkpoint wird jenseits der Wurzel aus n etwa jede Minute der Stand in
+  die Datei geschrieben: die Zahl, die Zähler, die Länge der Ausgabe und das
+  Sieb (der Heap samt wartender Primfaktoren). Mit --resume wird ein
+  abgebrochener Lauf dort fortgesetzt; die Ausgabe (eine Datei, mit ">>" oder
+  "1<>" umgeleitet) wird dafür auf den Stand des Checkpoints gekürzt.
 
   Compile: cc -O2 -o primes primes.c -lm
      oder: cl /nologo /O2 /Fe: primes.exe primes.c
 ------------------------------------------------------------------------------*/
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 
 /*------------------------------------------------------------------------------
   Datentypen
 ------------------------------------------------------------------------------*/
 typedef unsigned long long int uint64;
 typedef unsigned int           uint32;
-typedef struct { uint64 n_start; uint64 n; } Parameters;
+typedef struct { uint64 n_start; uint64 n; int count_only; const char* checkpoint_file; int resume; } Parameters;
 typedef uint32 uint_f;
-typedef struct { uint64 multiple; uint_f factor; } Factor;
-typedef Factor* Sieve;
+typedef struct { uint32 multiple; uint_f factor; } Factor;
+typedef struct { Factor* heap; uint32 count; uint32 total; uint32 base; uint64 next_square; } Sieve;
 
 /*------------------------------------------------------------------------------
   Prototypen
@@ -32,33 +53,62 @@ Parameters get_parameters(int argc, char** argv);
 uint64 atoul(const char* s);
 void print_primes_up_to(uint64 n);
 void print_prime(uint64 prime_number);
+void print_count(void);
 uint32 integer_square_root(uint64 x);
 uint32 estimate_number_of_primes_up_to(uint32 x);
 Sieve create_sieve(uint32 odd_prime_factors_count);
-void fill_sieve_and_print_primes(Sieve sieve, uint_f sqrt_n);
-void sieve_and_print_other_primes(Sieve sieve, uint_f sqrt_n, uint64 n);
-void add_to_sieve(Sieve sieve, uint_f factor);
-void sort_sieve(Sieve sieve);
-void split_sieve(Sieve sieve, Sieve sieve_head, Sieve* sieve_head_end, Sieve* sieve_tail);
-void merge_sieve(Sieve sieve_head, Sieve sieve_head_end, Sieve sieve_tail, Sieve sieve);
+void fill_sieve_and_print_primes(Sieve* sieve, uint_f sqrt_n);
+void sieve_and_print_other_primes(Sieve* sieve, uint64 from, uint64 n);
+void add_to_sieve(Sieve* sieve, uint_f factor);
+void activate_next_factor(Sieve* sieve);
+void next_multiples(Sieve* sieve);
+void sift_up(Sieve* sieve, uint32 i);
+void sift_down(Sieve* sieve, uint32 i);
+uint64 resume_checkpoint(Sieve* sieve);
+void save_checkpoint(const Sieve* sieve, uint64 number);
+void checkpoint_error(const char* file_name);
 
 /*------------------------------------------------------------------------------
   globale Variablen
 ------------------------------------------------------------------------------*/
 uint64 n_start;
+int    count_only;
+uint64 primes_count;  /* Anzahl der bisher gefundenen Primzahlen */
+uint64 first_serial;  /* Nummer und Wert der ersten Primzahl >= n_start */
+uint64 first_prime;
+uint64 last_prime;
+uint64 output_written;  /* Anzahl der ausgegebenen Bytes */
+uint64 n_end;
+const char* checkpoint_file;
+int    resume;
+time_t checkpoint_due;  /* Zeit des nächsten Checkpoints */
 
 /*------------------------------------------------------------------------------
   Macros
 ------------------------------------------------------------------------------*/
 #define odd(n) ((n - 1) | 1)
 
+#define CHECKPOINT_INTERVAL 60                /* Sekunden */
+#define CHECKPOINT_MASK     ((1ULL << 21) - 1) /* Uhr nur alle 2^20 Zahlen lesen */
+#define CHECKPOINT_VALUES   13                /* Kopf: "PRIMECK2" und 13 uint64 */
+
 /*------------------------------------------------------------------------------
   Beginn der Verarbeitung
 ------------------------------------------------------------------------------*/
 int main(int argc, char* argv[]) {
   Parameters p = get_parameters(argc, argv);
   n_start = p.n_start;
+  n_end = p.n;
+  count_only = p.count_only;
+  checkpoint_file = p.checkpoint_file;
+  resume = p.resume;
   print_primes_up_to(p.n);
+  if (count_only) {
+    print_count();
+  }
+  if (checkpoint_file != NULL) {
+    remove(checkpoint_file);
+  }
   return 0;
 }
 
@@ -68,11 +118,30 @@ int main(int argc, char* argv[]) {
 Parameters get_parameters(int argc, char** argv) {
   Parameters p;
 
+  p.count_only = 0;
+  p.checkpoint_file = NULL;
+  p.resume = 0;
+  while (argc > 1 && argv[1][0] == '-') {
+    if (strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "--count") == 0) {
+      p.count_only = 1;
+    } else if (strcmp(argv[1], "--resume") == 0) {
+      p.resume = 1;
+    } else if (strcmp(argv[1], "--checkpoint") == 0 && argc > 2) {
+      p.checkpoint_file = argv[2];
+      argc -= 1;
+      argv += 1;
+    } else {
+      break;
+    }
+    argc -= 1;
+    argv += 1;
+  }
   if (   argc != 2 && argc != 3
+      || p.resume && p.checkpoint_file == NULL
       || argc == 2 && (   (p.n_start = 1, p.n = atoul(argv[1])) < 1)
       || argc == 3 && (   (p.n_start =          atoul(argv[1])) < 1
                        || (               p.n = atoul(argv[2])) < 1)) {
-     fprintf(stderr, "usage: primes [From-Number (in (0,2^64))] To-Number (in (0..2^64))\n");
+     fprintf(stderr, "usage: primes [--count] [--checkpoint File [--resume]] [From-Number (in (0,2^64))] To-Number (in (0..2^64))\n");
      exit(1);
   }
   return p;
@@ -102,17 +171,20 @@ void print_primes_up_to(uint64 n) {
   if (n < 2) {
     return;
   }
-  print_prime(2);
-
-  if (n < 3) {
-    return;
-  }
 
   uint32 sqrt_n = odd(integer_square_root(n));
   uint32 prime_factors_count_estimated = estimate_number_of_primes_up_to(sqrt_n);
   Sieve sieve = create_sieve(prime_factors_count_estimated);
-  fill_sieve_and_print_primes(sieve, sqrt_n);
-  sieve_and_print_other_primes(sieve, sqrt_n, n);
+  uint64 from = resume_checkpoint(&sieve);
+  if (from == 0) {
+    print_prime(2);
+    if (n >= 3) {
+      fill_sieve_and_print_primes(&sieve, sqrt_n);
+    }
+    from = (uint64) sqrt_n + 2;
+  }
+  sieve_and_print_other_primes(&sieve, from, n);
+  free(sieve.heap);
 }
 
 /*------------------------------------------------------------------------------
@@ -121,11 +193,170 @@ void print_primes_up_to(uint64 n) {
   Primzahlen die kleiner als n_start sind, werden nicht ausgegeben.
 ------------------------------------------------------------------------------*/
 void print_prime(uint64 prime_number) {
-  static uint64 primes_count = 0;
   primes_count += 1;
   if (prime_number >= n_start) {
-    printf("%llu. prime = %llu\n", primes_count, prime_number);
+    if (count_only) {
+      if (first_serial == 0) {
+        first_serial = primes_count;
+        first_prime = prime_number;
+      }
+      last_prime = prime_number;
+    } else {
+      output_written += printf("%llu. prime = %llu\n", primes_count, prime_number);
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Gibt die Anzahl der Primzahlen >= n_start und die erste und letzte aus.
+------------------------------------------------------------------------------*/
+void print_count(void) {
+  if (first_serial == 0) {
+    printf("0 primes\n");
+    return;
+  }
+  printf("%llu primes\n", primes_count - first_serial + 1);
+  printf("first: %llu. prime = %llu\n", first_serial, first_prime);
+  printf("last: %llu. prime = %llu\n", primes_count, last_prime);
+}
+
+/*------------------------------------------------------------------------------
+  Bereitet die Checkpoints vor. Mit --resume werden die Zähler und das Sieb aus
+  dem Checkpoint übernommen und die Ausgabe auf dessen Stand gekürzt (ohne
+  Checkpoint: geleert).
+  Zurückgegeben wird die Zahl, bei der es weitergeht; 0: von vorn.
+------------------------------------------------------------------------------*/
+uint64 resume_checkpoint(Sieve* sieve) {
+  uint64 values[CHECKPOINT_VALUES];
+  char magic[8];
+  uint64 number = 0;
+
+  if (checkpoint_file == NULL) {
+    return 0;
+  }
+  checkpoint_due = time(NULL) + CHECKPOINT_INTERVAL;
+#ifdef _WIN32
+  int fd = _fileno(stdout);
+  struct _stat64 st;
+  if (!count_only && (_fstat64(fd, &st) != 0 || (st.st_mode & _S_IFMT) != _S_IFREG)) {
+#else
+  int fd = fileno(stdout);
+  struct stat st;
+  if (!count_only && (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))) {
+#endif
+    fprintf(stderr, "%s: the output must be a regular file\n", checkpoint_file);
+    exit(3);
+  }
+  if (!resume) {
+    return 0;
+  }
+
+  FILE* file = fopen(checkpoint_file, "rb");
+  if (file == NULL && errno != ENOENT) {
+    checkpoint_error(checkpoint_file);
+  }
+  if (file != NULL) {
+    if (   fread(magic, 1, 8, file) != 8 || memcmp(magic, "PRIMECK2", 8) != 0
+        || fread(values, sizeof(uint64), CHECKPOINT_VALUES, file) != CHECKPOINT_VALUES) {
+      fprintf(stderr, "%s: not a checkpoint of primes-alternative-2\n", checkpoint_file);
+      exit(3);
+    }
+    if (values[0] != n_start || values[1] != n_end || values[2] != (uint64) count_only) {
+      fprintf(stderr, "%s: checkpoint of another range or format\n", checkpoint_file);
+      exit(3);
+    }
+    number = values[3];
+    primes_count = values[4];
+    first_serial = values[5];
+    first_prime = values[6];
+    last_prime = values[7];
+    output_written = values[8];
+    sieve->count = (uint32) values[9];
+    sieve->total = (uint32) values[10];
+    sieve->base = (uint32) values[11];
+    sieve->next_square = values[12];
+    if (fread(sieve->heap, sizeof(Factor), sieve->total, file) != sieve->total) {
+      fprintf(stderr, "%s: truncated checkpoint\n", checkpoint_file);
+      exit(3);
+    }
+    fclose(file);
+  }
+
+  if (count_only) {
+    return number;
+  }
+  if ((uint64) st.st_size < output_written) {
+    fprintf(stderr, "%s: the output is shorter than at the checkpoint\n", checkpoint_file);
+    exit(3);
+  }
+#ifdef _WIN32
+  if (_chsize_s(fd, output_written) != 0 || _fseeki64(stdout, output_written, SEEK_SET) != 0) {
+#else
+  if (ftruncate(fd, (off_t) output_written) != 0 || fseeko(stdout, (off_t) output_written, SEEK_SET) != 0) {
+#endif
+    perror("output error");
+    exit(3);
   }
+  return number;
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt einen Checkpoint, sofern der nächste fällig ist; number ist die
+  nächste Zahl.
+
+  Die Ausgabe kommt vorher auf die Platte, der Checkpoint als temporäre Datei,
+  die dann umbenannt wird: es gibt also immer einen vollständigen.
+------------------------------------------------------------------------------*/
+void save_checkpoint(const Sieve* sieve, uint64 number) {
+  if (time(NULL) < checkpoint_due) {
+    return;
+  }
+#ifdef _WIN32
+  if (fflush(stdout) != 0 || !count_only && _commit(_fileno(stdout)) != 0) {
+#else
+  if (fflush(stdout) != 0 || !count_only && fsync(fileno(stdout)) != 0) {
+#endif
+    perror("output error");
+    exit(3);
+  }
+
+  char temp_name[4096];
+  if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", checkpoint_file) >= (int) sizeof(temp_name)) {
+    fprintf(stderr, "%s: file name too long\n", checkpoint_file);
+    exit(3);
+  }
+  uint64 values[CHECKPOINT_VALUES] = {
+    n_start, n_end, (uint64) count_only, number, primes_count,
+    first_serial, first_prime, last_prime, output_written,
+    sieve->count, sieve->total, sieve->base, sieve->next_square
+  };
+  FILE* file = fopen(temp_name, "wb");
+  if (   file == NULL
+      || fwrite("PRIMECK2", 1, 8, file) != 8
+      || fwrite(values, sizeof(uint64), CHECKPOINT_VALUES, file) != CHECKPOINT_VALUES
+      || fwrite(sieve->heap, sizeof(Factor), sieve->total, file) != sieve->total) {
+    checkpoint_error(temp_name);
+  }
+#ifdef _WIN32
+  if (fflush(file) != 0 || _commit(_fileno(file)) != 0 || fclose(file) != 0) {
+#else
+  if (fflush(file) != 0 || fsync(fileno(file)) != 0 || fclose(file) != 0) {
+#endif
+    checkpoint_error(temp_name);
+  }
+#ifdef _WIN32
+  if (!MoveFileExA(temp_name, checkpoint_file, MOVEFILE_REPLACE_EXISTING)) {
+#else
+  if (rename(temp_name, checkpoint_file) != 0) {
+#endif
+    checkpoint_error(checkpoint_file);
+  }
+  checkpoint_due = time(NULL) + CHECKPOINT_INTERVAL;
+}
+
+void checkpoint_error(const char* file_name) {
+  perror(file_name);
+  exit(3);
 }
 
 /*------------------------------------------------------------------------------
@@ -138,7 +369,7 @@ uint32 integer_square_root(uint64 x) {
 }
 
 /*------------------------------------------------------------------------------
-  Berechnet eine Abschtzung EPRIM fr die Anzahl der Primzahlen <= x.
+  Berechnet eine Abschätzung EPRIM für die Anzahl der Primzahlen <= x.
   Es gilt: EPRIM >= pi(x)
 ------------------------------------------------------------------------------*/
 uint32 estimate_number_of_primes_up_to(uint32 x) {
@@ -149,11 +380,24 @@ uint32 estimate_number_of_primes_up_to(uint32 x) {
 }
 
 /*------------------------------------------------------------------------------
-  Das Sieb enthlt fr jeden ungeraden Primfaktor einen Eintrag (plus 1 mehr).
+  Das Sieb enthält für jeden ungeraden Primfaktor einen Eintrag.
+
+  Ein Eintrag hat nur 8 Bytes: vom nächsten Vielfachen m wird nur (m / 2) mod
+  2^32 gespeichert. Alle Vielfachen im Heap liegen zwischen der aktuellen Zahl
+  und dieser plus 2 * Primfaktor, die Hälften also in einem Fenster von weniger
+  als 2^32 ab base = (Zahl / 2) mod 2^32. Verglichen wird deshalb multiple -
+  base (mod 2^32); so entfällt jedes Umrechnen beim Weiterrücken.
+
+  Die Einträge 0 bis count - 1 bilden den Heap. Dahinter (bis total - 1)
+  warten die Primfaktoren, deren Quadrat noch nicht erreicht ist.
 ------------------------------------------------------------------------------*/
 Sieve create_sieve(uint32 odd_prime_factors_count) {
-  Sieve sieve = malloc(odd_prime_factors_count * sizeof(Factor));
-  if (sieve == NULL) {
+  Sieve sieve;
+  sieve.heap = malloc(odd_prime_factors_count * sizeof(Factor));
+  sieve.count = 0;
+  sieve.total = 0;
+  sieve.next_square = 0;
+  if (sieve.heap == NULL) {
     perror("memory error");
     exit(2);
   }
@@ -161,27 +405,29 @@ Sieve create_sieve(uint32 odd_prime_factors_count) {
 }
 
 /*------------------------------------------------------------------------------
-  Fllt das Sieb der Reihe nach mit allen ungeraden Primzahlen <= Wurzel aus n
+  Füllt das Sieb der Reihe nach mit allen ungeraden Primzahlen <= Wurzel aus n
   und gibt sie aus.
 
-  Das Sieb ist eine Liste aller ungeraden Primzahlen <= Wurzel aus n, und deren
-  nchstem ungeraden Vielfachen; nach letzteren ist das Sieb sortiert.
+  Das Sieb enthält alle ungeraden Primzahlen <= Wurzel aus n mit deren nächstem
+  ungeraden Vielfachen, und zwar als Heap nach den Vielfachen: das kleinste
+  Vielfache steht immer vorne. In den Heap kommt ein Primfaktor erst, wenn die
+  Zahlen sein Quadrat erreichen; bis dahin wartet er hinter dem Heap.
 
-  Wenn eine Zahl vorne im Sieb steht, dann ist sie keine Primzahl. Die nchsten
-  Vielfachen ihrer Primfaktoren mssen dann neu einsortiert werden.
+  Wenn eine Zahl vorne im Sieb steht oder das Quadrat des nächsten wartenden
+  Primfaktors ist, dann ist sie keine Primzahl. Die nächsten Vielfachen ihrer
+  Primfaktoren müssen dann neu einsortiert werden.
 
-  Wenn die Zahl nicht vorne im Sieb steht, dann ist sie eine Primzahl. Diese
-  wird hinten am Ende des Siebs angefgt.
+  Sonst ist die Zahl eine Primzahl. Diese wird dem Sieb hinzugefügt.
 ------------------------------------------------------------------------------*/
-void fill_sieve_and_print_primes(Sieve sieve, uint_f sqrt_n) {
-  Sieve sieve_end = sieve;
-
+void fill_sieve_and_print_primes(Sieve* sieve, uint_f sqrt_n) {
   print_prime(3);
   add_to_sieve(sieve, 3);
 
   for (uint_f number = 5; number <= sqrt_n; number += 2) {
-    if (number == sieve[0].multiple) { // keine Primzahl
-      sort_sieve(sieve);
+    if (number == sieve->next_square) { // keine Primzahl
+      activate_next_factor(sieve);
+    } else if ((uint32) (number >> 1) == sieve->heap[0].multiple) { // keine Primzahl
+      next_multiples(sieve);
     } else { // Primzahl
       print_prime(number);
       add_to_sieve(sieve, number);
@@ -190,13 +436,19 @@ void fill_sieve_and_print_primes(Sieve sieve, uint_f sqrt_n) {
 }
 
 /*------------------------------------------------------------------------------
-  Gibt der Reihe nach die brigen Primzahlen <= n aus, indem Zahlen, die
-  Vielfache mindestens eines Primfaktors sind, ausgeschlossen werden.
+  Gibt der Reihe nach die übrigen Primzahlen ab from (> Wurzel aus n) bis n aus,
+  indem Zahlen, die Vielfache mindestens eines Primfaktors sind, ausgeschlossen
+  werden.
 ------------------------------------------------------------------------------*/
-void sieve_and_print_other_primes(Sieve sieve, uint_f sqrt_n, uint64 n) {
-  for (uint64 number = (uint64) sqrt_n + 2; number <= n; number += 2) {
-    if (number == sieve[0].multiple) { // keine Primzahl
-      sort_sieve(sieve);
+void sieve_and_print_other_primes(Sieve* sieve, uint64 from, uint64 n) {
+  for (uint64 number = from; number <= n; number += 2) {
+    if ((number & CHECKPOINT_MASK) == 1 && checkpoint_file != NULL) {
+      save_checkpoint(sieve, number);
+    }
+    if (number == sieve->next_square) { // keine Primzahl
+      activate_next_factor(sieve);
+    } else if ((uint32) (number >> 1) == sieve->heap[0].multiple) { // keine Primzahl
+      next_multiples(sieve);
     } else { // Primzahl
       print_prime(number);
     }
@@ -204,74 +456,104 @@ void sieve_and_print_other_primes(Sieve sieve, uint_f sqrt_n, uint64 n) {
 }
 
 /*------------------------------------------------------------------------------
-  Fgt dem Sieb eine neue ungerade Primzahl hinzu, und zwar am Ende, weil die
-  neue Zahl (bzw. ihr Vielfaches) die bis dahin gte ist.
-  Das nchste relevante Vielfache ist ihr Quadrat, weil alle ihre kleineren
-  Vielfachen bereits Vielfache einer kleineren Primzahl sind.
+  Fügt dem Sieb eine neue ungerade Primzahl hinzu.
+  Das nächste relevante Vielfache ist ihr Quadrat, weil alle ihre kleineren
+  Vielfachen bereits Vielfache einer kleineren Primzahl sind. Bis dahin wartet
+  sie hinter dem Heap.
 ------------------------------------------------------------------------------*/
-void add_to_sieve(Sieve sieve, uint_f factor) {
-  static uint32 sieve_len = 0;
+void add_to_sieve(Sieve* sieve, uint_f factor) {
+  uint64 square = (uint64) factor * (uint64) factor;
 
-  sieve[sieve_len].multiple = (uint64) factor * (uint64) factor;
-  sieve[sieve_len++].factor = factor;
-
-  /* die folgende Zuweisung spart beim Mischen eine zustzliche Ende-Prfung */
-  sieve[sieve_len].multiple = (uint64) -1;
+  sieve->heap[sieve->total].multiple = (uint32) (square >> 1);
+  sieve->heap[sieve->total].factor = factor;
+  if (sieve->total++ == sieve->count) {
+    sieve->next_square = square;
+  }
 }
 
 /*------------------------------------------------------------------------------
-  Sortiert das Sieb neu, nachdem die Primfaktoren mit den gleichen Vielfachen
-  am Anfang des Siebs neue Vielfache erhalten haben.
-
-  Neu einsortiert werden mssen nur die Primfaktoren mit einem neuen Vielfachen.
-  Diese schon sortierte Liste wird mit den brigen (sowieso sortierten)
-  Primfaktoren nur noch gemischt.
-
-  Das Produkt der ersten 16 ungeraden Primzahlen ist grer als 2^64. Mehr als
-  16 gleiche Vielfache kann es also nicht geben.
+  Die aktuelle Zahl ist das Quadrat des nächsten wartenden Primfaktors: dieser
+  kommt mit seinem nächsten ungeraden Vielfachen in den Heap.
 ------------------------------------------------------------------------------*/
-void sort_sieve(Sieve sieve) {
-  Factor sieve_head[16];
-  Sieve  sieve_head_end;
-  Sieve  sieve_tail;
+void activate_next_factor(Sieve* sieve) {
+  Factor* factor = &sieve->heap[sieve->count];
 
-  split_sieve(sieve, sieve_head, &sieve_head_end, &sieve_tail);
-  merge_sieve(sieve_head, sieve_head_end, sieve_tail, sieve);
+  sieve->base = factor->multiple;
+  factor->multiple += factor->factor;
+  sift_up(sieve, sieve->count++);
+
+  sieve->next_square = 0;
+  if (sieve->count < sieve->total) {
+    uint64 next = sieve->heap[sieve->count].factor;
+    sieve->next_square = next * next;
+  }
 }
 
 /*------------------------------------------------------------------------------
-  Kopiert die Primfaktoren mit den gleichen Vielfachen vom Anfang des Siebs in
-  einen anderen Bereich und vergibt dabei die neuen Vielfachen.
+  Vergibt allen Primfaktoren, deren Vielfaches vorne im Sieb steht, ihr
+  nächstes ungerades Vielfaches und sortiert sie im Heap neu ein.
 
-  Diese Liste ist bereits korrekt sortiert, da bei gleichen Vielfachen die
-  kleineren Primfaktoren zuerst kommen. Bei der neuen Vielfachenbildung
-  erhalten die kleineren Primfaktoren dann auch kleinere neue Vielfache.
+  Der Heap ist 4-fach (Kinder von i: 4 * i + 1 bis 4 * i + 4): er ist nur halb
+  so tief wie ein binärer, und die 4 Kinder liegen in einer Cache-Line. Jedes
+  Einsortieren kostet so O(log(Anzahl der Primfaktoren)) statt wie beim
+  Mischen eines sortierten Arrays O(Position des neuen Vielfachen).
 ------------------------------------------------------------------------------*/
-void split_sieve(Sieve sieve, Sieve sieve_head, Sieve* sieve_head_end, Sieve* sieve_tail) {
-  Sieve  head = sieve_head;
-  uint64 multiple = sieve->multiple;
+void next_multiples(Sieve* sieve) {
+  Factor* heap = sieve->heap;
+  uint32  multiple = heap[0].multiple;
 
+  sieve->base = multiple;
   do {
-    head->multiple = multiple + (uint64) sieve->factor * 2;
-    head++->factor = sieve++->factor;
-  } while (sieve->multiple == multiple);
-  
-  *sieve_head_end = head;
-  *sieve_tail = sieve;
+    heap[0].multiple += heap[0].factor;  /* + 2 * Primfaktor, halbiert */
+    sift_down(sieve, 0);
+  } while (heap[0].multiple == multiple);
 }
 
 /*------------------------------------------------------------------------------
-  Mischt die kopierten Primfaktoren mit den ehemals gleichen und jetzt neu
-  vergebenen Vielfachen vom Anfang des Siebs mit dem brigen Sieb.
-
-  Obwohl das Sieb nach Vielfachen UND (bei Gleichheit) nach Primfaktoren
-  sortiert ist, reicht ein Vergleich der Vielfachen, denn die Sortierung nach
-  Primfaktoren ist automatisch gegeben.
+  Schiebt den Eintrag i im Heap nach oben bzw. unten, bis er an seinem Platz
+  steht.
 ------------------------------------------------------------------------------*/
-void merge_sieve(Sieve sieve_head, Sieve sieve_head_end, Sieve sieve_tail, Sieve sieve) {
-  while (sieve_head < sieve_head_end) {
-    *sieve++ = (sieve_head->multiple <= sieve_tail->multiple)
-             ? *sieve_head++
-             : *sieve_tail++;
+void sift_up(Sieve* sieve, uint32 i) {
+  Factor* heap = sieve->heap;
+  Factor  factor = heap[i];
+  uint32  base = sieve->base;
+
+  while (i > 0 && heap[(i - 1) / 4].multiple - base > factor.multiple - base) {
+    heap[i] = heap[(i - 1) / 4];
+    i = (i - 1) / 4;
+  }
+  heap[i] = factor;
+}
+
+void sift_down(Sieve* sieve, uint32 i) {
+  Factor* heap = sieve->heap;
+  Factor  factor = heap[i];
+  uint32  count = sieve->count;
+  uint32  base = sieve->base;
+
+  for (;;) {
+    uint32 child = 4 * i + 1;
+    uint32 min = child;
+
+    if (child + 3 < count) {
+      /* alle 4 Kinder da: Minimum ohne Sprünge bestimmen */
+      uint32 a = child + (heap[child + 1].multiple - base < heap[child].multiple - base);
+      uint32 b = child + 2 + (heap[child + 3].multiple - base < heap[child + 2].multiple - base);
+      min = (heap[b].multiple - base < heap[a].multiple - base) ? b : a;
+    } else if (child < count) {
+      for (uint32 k = child + 1; k < count; k++) {
+        if (heap[k].multiple - base < heap[min].multiple - base) {
+          min = k;
+        }
+      }
+    } else {
+      break;
+    }
+    if (heap[min].multiple - base >= factor.multiple - base) {
+      break;
+    }
+    heap[i] = heap[min];
+    i = min;
   }
+  heap[i] = factor;
 }
@@ -0,0 +1,386 @@
+/*------------------------------------------------------------------------------
+  P R I M E S - B E N C H . C
+
+  Zeitmessung von primes, primes-alternative-1 und primes-alternative-2
+
+  Aufruf: primes-bench [-a] [Programm-Verzeichnis]
+
+  Jedes Programm wird für feste Bereiche einmal mit --count und einmal mit
+  Ausgabe aufgerufen; die Ausgabe wird über eine Pipe gelesen und nur gezählt.
+  Geprüft wird jeder Lauf gegen bekannte Werte von pi(x): die Anzahl der
+  Primzahlen sowie die Nummer der ersten und letzten.
+
+  Bereiche: [1, 10^k] für k = 6 bis 10 (primes-alternative-1 und -2 nur bis
+  10^9, da sie immer ab 1 sieben) und nur für primes Fenster der Breite 10^9
+  ab 10^12, 10^15, 10^18 und bis 2^64 - 1. Die letzten beiden brauchen allein
+  für pi(n_start) Stunden; sie laufen nur mit -a.
+
+  Ausgegeben wird je Lauf eine CSV-Zeile (mit Kopfzeile):
+
+    engine,mode,from,to,primes,wall_s,cpu_s,primes_per_s,ns_per_number,
+    peak_rss_kib,check
+
+  Compile: cc -O2 -o primes-bench primes-bench.c
+     oder: cl /nologo /O2 /Fe: primes-bench.exe primes-bench.c psapi.lib
+------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/*------------------------------------------------------------------------------
+  Datentypen
+------------------------------------------------------------------------------*/
+typedef unsigned long long int uint64;
+typedef unsigned int           uint32;
+
+typedef struct {
+  int         all;
+  const char* directory;
+} Parameters;
+
+#define ENGINES_COUNT   3
+#define ENGINE_ALL      7
+#define ENGINE_PRIMES   1
+
+typedef struct {
+  uint64 from;
+  uint64 to;
+  uint64 pi_before;  /* pi(from - 1) */
+  uint64 pi_to;      /* pi(to) */
+  uint32 engines;    /* Bitmaske der Programme, die den Bereich sieben */
+  int    long_run;   /* nur mit -a */
+} Range;
+
+#define BUFFER_SIZE     (1 << 20)
+#define LINE_SIZE       256
+
+typedef struct {
+  uint64 primes;        /* Anzahl der Primzahlen (--count) bzw. Zeilen */
+  uint64 first_serial;  /* Nummer der ersten Primzahl (nur --count) */
+  uint64 last_serial;   /* Nummer der letzten Primzahl */
+  double wall;
+  double cpu;
+  uint64 peak_rss;      /* KiB */
+  int    status;
+} Run;
+
+typedef struct {
+  char   text[LINE_SIZE];
+  size_t size;
+} Line;
+
+/*------------------------------------------------------------------------------
+  Prototypen
+------------------------------------------------------------------------------*/
+Parameters get_parameters(int argc, char** argv);
+int bench_range(const Parameters* p, const char* engine, const Range* range, int count_only);
+void run_engine(const char* program, const Range* range, int count_only, Run* run);
+void scan_output(Run* run, const char* data, size_t size, Line* line, int count_only);
+void append_line(Line* line, const char* data, size_t length);
+void scan_line(Run* run, const char* line, int count_only);
+double wall_clock(void);
+
+/*------------------------------------------------------------------------------
+  globale Variablen
+------------------------------------------------------------------------------*/
+const char* engines[ENGINES_COUNT] = { "primes", "primes-alternative-1", "primes-alternative-2" };
+
+/* pi(10^k), pi(10^18) und pi(2^64 - 1) sind bekannt; die Anzahl in den Fenstern
+   wurde mit primes und libprimes gezählt */
+const Range ranges[] = {
+  { 1, 1000000ULL,       0, 78498ULL,     ENGINE_ALL, 0 },
+  { 1, 10000000ULL,      0, 664579ULL,    ENGINE_ALL, 0 },
+  { 1, 100000000ULL,     0, 5761455ULL,   ENGINE_ALL, 0 },
+  { 1, 1000000000ULL,    0, 50847534ULL,  ENGINE_ALL, 0 },
+  { 1, 10000000000ULL,   0, 455052511ULL, ENGINE_PRIMES, 0 },
+  { 1000000000000ULL, 1001000000000ULL,
+    37607912018ULL, 37644103009ULL, ENGINE_PRIMES, 0 },
+  { 1000000000000000ULL, 1000001000000000ULL,
+    29844570422669ULL, 29844599369090ULL, ENGINE_PRIMES, 0 },
+  { 1000000000000000000ULL, 1000000001000000000ULL,
+    24739954287740860ULL, 24739954311867945ULL, ENGINE_PRIMES, 1 },
+  { 18446744072709551616ULL, 18446744073709551615ULL,
+    425656284012679877ULL, 425656284035217743ULL, ENGINE_PRIMES, 1 },
+};
+
+/*------------------------------------------------------------------------------
+  Beginn der Verarbeitung
+------------------------------------------------------------------------------*/
+int main(int argc, char* argv[]) {
+  Parameters p = get_parameters(argc, argv);
+  int failed = 0;
+
+  printf("engine,mode,from,to,primes,wall_s,cpu_s,primes_per_s,ns_per_number,peak_rss_kib,check\n");
+  fflush(stdout);
+  for (uint32 e = 0; e < ENGINES_COUNT; e++) {
+    for (uint32 r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+      if ((ranges[r].engines & (1U << e)) == 0 || ranges[r].long_run && !p.all) {
+        continue;
+      }
+      failed |= bench_range(&p, engines[e], &ranges[r], 1);
+      failed |= bench_range(&p, engines[e], &ranges[r], 0);
+    }
+  }
+  return failed ? 4 : 0;
+}
+
+/*------------------------------------------------------------------------------
+  Optionen und Programm-Verzeichnis aus den Kommandozeilen-Parametern ermitteln
+------------------------------------------------------------------------------*/
+Parameters get_parameters(int argc, char** argv) {
+  Parameters p;
+
+  p.all = 0;
+  if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+    p.all = 1;
+    argc -= 1;
+    argv += 1;
+  }
+  if (argc > 2 || argc == 2 && argv[1][0] == '-') {
+    fprintf(stderr, "usage: primes-bench [-a] [Program-Directory]\n"
+                    "  -a                 include the windows at 10^18 and 2^64 (hours)\n");
+    exit(1);
+  }
+  p.directory = (argc == 2) ? argv[1] : ".";
+  return p;
+}
+
+/*------------------------------------------------------------------------------
+  Misst ein Programm in einem Bereich, prüft das Ergebnis und gibt die
+  CSV-Zeile aus. Zurückgegeben wird 1, wenn die Prüfung fehlschlägt.
+------------------------------------------------------------------------------*/
+int bench_range(const Parameters* p, const char* engine, const Range* range, int count_only) {
+  char program[1024];
+  Run run;
+
+#ifdef _WIN32
+  snprintf(program, sizeof(program), "%s\\%s.exe", p->directory, engine);
+#else
+  snprintf(program, sizeof(program), "%s/%s", p->directory, engine);
+#endif
+  run_engine(program, range, count_only, &run);
+
+  uint64 expected = range->pi_to - range->pi_before;
+  int ok =    run.status == 0
+           && run.primes == expected
+           && (expected == 0 || run.last_serial == range->pi_to)
+           && (!count_only || expected == 0 || run.first_serial == range->pi_before + 1);
+
+  double numbers = (double) (range->to - range->from) + 1;
+  printf("%s,%s,%llu,%llu,%llu,%.3f,%.3f,%.0f,%.3f,%llu,%s\n",
+         engine, count_only ? "count" : "output", range->from, range->to, run.primes,
+         run.wall, run.cpu, run.wall > 0 ? run.primes / run.wall : 0,
+         run.wall * 1e9 / numbers, run.peak_rss, ok ? "ok" : "FAILED");
+  fflush(stdout);
+  return !ok;
+}
+
+/*------------------------------------------------------------------------------
+  Startet ein Programm, liest dessen Ausgabe über eine Pipe und misst Wall- und
+  CPU-Zeit sowie den maximalen Speicherbedarf (Resident Set Size).
+------------------------------------------------------------------------------*/
+void run_engine(const char* program, const Range* range, int count_only, Run* run) {
+  char from[24], to[24];
+  char* buffer = malloc(BUFFER_SIZE);
+  Line line;
+
+  if (buffer == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  memset(run, 0, sizeof(*run));
+  line.size = 0;
+  snprintf(from, sizeof(from), "%llu", range->from);
+  snprintf(to, sizeof(to), "%llu", range->to);
+  double start = wall_clock();
+
+#ifdef _WIN32
+  char command[1200];
+  SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+  STARTUPINFOA si;
+  PROCESS_INFORMATION pi;
+  HANDLE read_end, write_end;
+
+  snprintf(command, sizeof(command), "\"%s\" %s%s %s", program, count_only ? "--count " : "", from, to);
+  memset(&si, 0, sizeof(si));
+  si.cb = sizeof(si);
+  si.dwFlags = STARTF_USESTDHANDLES;
+  si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+  si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+  if (   !CreatePipe(&read_end, &write_end, &sa, BUFFER_SIZE)
+      || !SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0)
+      || (si.hStdOutput = write_end,
+          !CreateProcessA(NULL, command, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi))) {
+    fprintf(stderr, "%s: cannot start (error %lu)\n", program, GetLastError());
+    exit(3);
+  }
+  CloseHandle(write_end);
+
+  DWORD size;
+  while (ReadFile(read_end, buffer, BUFFER_SIZE, &size, NULL) && size > 0) {
+    scan_output(run, buffer, size, &line, count_only);
+  }
+  CloseHandle(read_end);
+  WaitForSingleObject(pi.hProcess, INFINITE);
+
+  DWORD exit_code;
+  FILETIME created, exited, kernel, user;
+  PROCESS_MEMORY_COUNTERS memory;
+  GetExitCodeProcess(pi.hProcess, &exit_code);
+  run->status = (int) exit_code;
+  if (GetProcessTimes(pi.hProcess, &created, &exited, &kernel, &user)) {
+    run->cpu = (  ((uint64) kernel.dwHighDateTime << 32 | kernel.dwLowDateTime)
+                + ((uint64) user.dwHighDateTime << 32 | user.dwLowDateTime)) * 1e-7;
+  }
+  if (GetProcessMemoryInfo(pi.hProcess, &memory, sizeof(memory))) {
+    run->peak_rss = memory.PeakWorkingSetSize / 1024;
+  }
+  CloseHandle(pi.hThread);
+  CloseHandle(pi.hProcess);
+#else
+  int fds[2];
+  pid_t pid;
+
+  if (pipe(fds) != 0 || (pid = fork()) < 0) {
+    perror(program);
+    exit(3);
+  }
+  if (pid == 0) {
+    dup2(fds[1], 1);
+    close(fds[0]);
+    close(fds[1]);
+    if (count_only) {
+      execl(program, program, "--count", from, to, (char*) NULL);
+    } else {
+      execl(program, program, from, to, (char*) NULL);
+    }
+    perror(program);
+    _exit(127);
+  }
+  close(fds[1]);
+
+  ssize_t size;
+  while ((size = read(fds[0], buffer, BUFFER_SIZE)) > 0) {
+    scan_output(run, buffer, (size_t) size, &line, count_only);
+  }
+  close(fds[0]);
+
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) {
+    perror(program);
+    exit(3);
+  }
+  run->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  run->cpu =   usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6
+             + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+  run->peak_rss = (uint64) usage.ru_maxrss;
+#endif
+
+  run->wall = wall_clock() - start;
+  free(buffer);
+}
+
+/*------------------------------------------------------------------------------
+  Zerlegt die Ausgabe in Zeilen. Mit --count wird jede ausgewertet (es sind nur
+  drei), sonst werden die Zeilen nur gezählt und die letzte ausgewertet.
+------------------------------------------------------------------------------*/
+void scan_output(Run* run, const char* data, size_t size, Line* line, int count_only) {
+  const char* end = data + size;
+
+  while (data < end) {
+    const char* newline = memchr(data, '\n', (size_t) (end - data));
+    if (newline == NULL) {
+      append_line(line, data, (size_t) (end - data));
+      return;
+    }
+    if (count_only) {
+      append_line(line, data, (size_t) (newline - data));
+      scan_line(run, line->text, count_only);
+      line->size = 0;
+      data = newline + 1;
+      continue;
+    }
+
+    /* letzte vollständige Zeile des Puffers: von begin bis last - 1 */
+    const char* last = end;
+    while (last[-1] != '\n') {
+      last--;
+    }
+    const char* begin = last - 1;
+    while (begin > data && begin[-1] != '\n') {
+      begin--;
+    }
+    if (begin > data) {
+      line->size = 0;
+    }
+    append_line(line, begin, (size_t) (last - 1 - begin));
+    scan_line(run, line->text, count_only);
+    line->size = 0;
+
+    for (const char* pos = data; pos < last; pos++) {
+      pos = memchr(pos, '\n', (size_t) (last - pos));
+      run->primes += 1;
+    }
+    data = last;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Hängt Zeichen an die aktuelle Zeile an; zu lange Zeilen werden gekürzt.
+------------------------------------------------------------------------------*/
+void append_line(Line* line, const char* data, size_t length) {
+  if (length > LINE_SIZE - 1 - line->size) {
+    length = LINE_SIZE - 1 - line->size;
+  }
+  memcpy(line->text + line->size, data, length);
+  line->size += length;
+  line->text[line->size] = 0;
+}
+
+/*------------------------------------------------------------------------------
+  Wertet eine Zeile aus: "Anzahl primes", "first: Nummer. prime = Primzahl",
+  "last: Nummer. prime = Primzahl" bzw. "Nummer. prime = Primzahl".
+------------------------------------------------------------------------------*/
+void scan_line(Run* run, const char* line, int count_only) {
+  uint64 serial;
+
+  if (!count_only) {
+    if (sscanf(line, "%llu. prime", &serial) == 1) {
+      run->last_serial = serial;
+    }
+  } else if (sscanf(line, "first: %llu.", &serial) == 1) {
+    run->first_serial = serial;
+  } else if (sscanf(line, "last: %llu.", &serial) == 1) {
+    run->last_serial = serial;
+  } else {
+    sscanf(line, "%llu primes", &run->primes);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Liefert eine fortlaufende Zeit in Sekunden.
+------------------------------------------------------------------------------*/
+double wall_clock(void) {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double) counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
@@ -0,0 +1,351 @@
+/*------------------------------------------------------------------------------
+  P R I M E S - D E C O D E . C
+
+  Ausgabe der Primzahlen aus einer Datei im Binärformat von primes -b
+
+  Aufruf: primes-decode [-p] Datei [Von-Zahl [Bis-Zahl]]
+
+  Die Ausgabe ist dieselbe wie die von primes (mit -p nur die Primzahlen).
+  Mit Von-Zahl wird über den Index der Datei direkt zur passenden Stelle
+  gesprungen; das geht nicht, wenn die Datei "-" (stdin) ist.
+
+  Das Format ist im Kopf von primes.c beschrieben.
+
+  Compile: cc -O2 -o primes-decode primes-decode.c
+     oder: cl /nologo /O2 /Fe: primes-decode.exe primes-decode.c
+------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+/*------------------------------------------------------------------------------
+  Datentypen
+------------------------------------------------------------------------------*/
+typedef unsigned long long int uint64;
+typedef unsigned int           uint32;
+typedef unsigned char          uint8;
+
+typedef struct {
+  int         plain;
+  const char* file_name;
+  uint64      n_start;
+  uint64      n;
+} Parameters;
+
+#define BUFFER_SIZE         (1 << 20)
+#define BUFFER_RESERVE      16          /* ein Varint ist höchstens 10 Bytes lang */
+#define HEADER_SIZE         32
+#define FOOTER_SIZE         40
+#define INDEX_ENTRY_SIZE    24
+#define OUTPUT_LINE_SIZE    64
+
+typedef struct {
+  FILE*  file;
+  uint8* data;
+  size_t pos;
+  size_t fill;
+  int    eof;
+} Input;
+
+/*------------------------------------------------------------------------------
+  Prototypen
+------------------------------------------------------------------------------*/
+Parameters get_parameters(int argc, char** argv);
+void decode_primes(const Parameters* p);
+void seek_to(Input* in, uint64 n_start, uint64* serial, uint64* prime_number);
+void refill(Input* in);
+uint64 get_uint64(const uint8* pos);
+char* format_number(char* pos, uint64 x);
+void write_output(char* buffer, size_t size);
+void format_error(void);
+uint64 atoul(const char* str);
+
+/*------------------------------------------------------------------------------
+  globale Variablen
+------------------------------------------------------------------------------*/
+const char digit_pairs[201] = "00010203040506070809101112131415161718192021222324"
+                              "25262728293031323334353637383940414243444546474849"
+                              "50515253545556575859606162636465666768697071727374"
+                              "75767778798081828384858687888990919293949596979899";
+
+/*------------------------------------------------------------------------------
+  Beginn der Verarbeitung
+------------------------------------------------------------------------------*/
+int main(int argc, char* argv[]) {
+  Parameters p = get_parameters(argc, argv);
+  decode_primes(&p);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+  Optionen, Datei, n_start und n aus den Kommandozeilen-Parametern ermitteln
+------------------------------------------------------------------------------*/
+Parameters get_parameters(int argc, char** argv) {
+  Parameters p;
+
+  p.plain = 0;
+  if (argc > 1 && strcmp(argv[1], "-p") == 0) {
+    p.plain = 1;
+    argc -= 1;
+    argv += 1;
+  }
+
+  p.n_start = 1;
+  p.n = 18446744073709551615ULL;
+  if (   argc < 2 || argc > 4
+      || argc >= 3 && (p.n_start = atoul(argv[2])) < 1
+      || argc == 4 && (p.n = atoul(argv[3])) < 1) {
+    fprintf(stderr, "usage: primes-decode [-p] File [From-Number (in (0,2^64)) [To-Number (in (0..2^64))]]\n"
+                    "  -p                 print the prime numbers only\n");
+    exit(1);
+  }
+  p.file_name = argv[1];
+  return p;
+}
+
+/*------------------------------------------------------------------------------
+  Liest die Abstände und gibt die Primzahlen zwischen n_start und n aus.
+------------------------------------------------------------------------------*/
+void decode_primes(const Parameters* p) {
+  Input in;
+  char* output = malloc(BUFFER_SIZE);
+  char* pos = output;
+  char* end = output + BUFFER_SIZE - OUTPUT_LINE_SIZE;
+
+  in.data = malloc(BUFFER_SIZE + BUFFER_RESERVE);
+  if (in.data == NULL || output == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  if (strcmp(p->file_name, "-") == 0) {
+    in.file = stdin;
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  } else if ((in.file = fopen(p->file_name, "rb")) == NULL) {
+    perror(p->file_name);
+    exit(3);
+  }
+  in.pos = 0;
+  in.fill = 0;
+  in.eof = 0;
+
+  refill(&in);
+  if (in.fill < HEADER_SIZE || memcmp(in.data, "PRIMEGAP", 8) != 0) {
+    format_error();
+  }
+  uint64 serial = get_uint64(in.data + 8);
+  uint64 prime_number = get_uint64(in.data + 16);
+  in.pos = HEADER_SIZE;
+  if (serial == 0) {
+    return;
+  }
+  if (prime_number < p->n_start && in.file != stdin) {
+    seek_to(&in, p->n_start, &serial, &prime_number);
+    refill(&in);
+  }
+
+  for (;;) {
+    if (prime_number > p->n) {
+      break;
+    }
+    if (prime_number >= p->n_start) {
+      if (!p->plain) {
+        pos = format_number(pos, serial);
+        memcpy(pos, ". prime = ", 10);
+        pos += 10;
+      }
+      pos = format_number(pos, prime_number);
+      *pos++ = '\n';
+      if (pos >= end) {
+        write_output(output, pos - output);
+        pos = output;
+      }
+    }
+
+    if (in.fill - in.pos < BUFFER_RESERVE) {
+      refill(&in);
+    }
+    if (in.pos >= in.fill) {
+      format_error();
+    }
+    uint64 code = in.data[in.pos++];
+    if (code >= 0x80) {
+      uint32 shift = 7;
+      uint8 byte;
+      code &= 0x7f;
+      do {
+        byte = in.data[in.pos++];
+        code |= (uint64) (byte & 0x7f) << shift;
+        shift += 7;
+      } while (byte & 0x80 && shift < 70);
+    }
+    if (code == 0) {
+      break;
+    }
+    prime_number = (prime_number == 2) ? 3 : prime_number + 2 * code;
+    serial += 1;
+  }
+
+  write_output(output, pos - output);
+  if (in.file != stdin) {
+    fclose(in.file);
+  }
+  free(in.data);
+  free(output);
+}
+
+/*------------------------------------------------------------------------------
+  Springt über den Index zur letzten Primzahl <= n_start.
+------------------------------------------------------------------------------*/
+void seek_to(Input* in, uint64 n_start, uint64* serial, uint64* prime_number) {
+  uint8 footer[FOOTER_SIZE];
+
+  if (   fseek64(in->file, -FOOTER_SIZE, SEEK_END) != 0
+      || fread(footer, 1, FOOTER_SIZE, in->file) != FOOTER_SIZE
+      || memcmp(footer + 32, "PRIMEEND", 8) != 0) {
+    format_error();
+  }
+  uint64 index_offset = get_uint64(footer + 16);
+  uint64 index_count = get_uint64(footer + 24);
+  if (index_count == 0) {
+    format_error();
+  }
+
+  uint8* index = malloc(index_count * INDEX_ENTRY_SIZE);
+  if (index == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  if (   fseek64(in->file, index_offset, SEEK_SET) != 0
+      || fread(index, INDEX_ENTRY_SIZE, index_count, in->file) != index_count) {
+    format_error();
+  }
+
+  /* letzter Eintrag mit Primzahl <= n_start */
+  uint64 low = 0;
+  uint64 high = index_count;
+  while (high - low > 1) {
+    uint64 middle = low + (high - low) / 2;
+    if (get_uint64(index + middle * INDEX_ENTRY_SIZE + 8) <= n_start) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  uint8* entry = index + low * INDEX_ENTRY_SIZE;
+  *serial = get_uint64(entry);
+  *prime_number = get_uint64(entry + 8);
+  if (fseek64(in->file, get_uint64(entry + 16), SEEK_SET) != 0) {
+    format_error();
+  }
+  free(index);
+
+  in->pos = 0;
+  in->fill = 0;
+  in->eof = 0;
+}
+
+/*------------------------------------------------------------------------------
+  Schiebt den Rest des Eingabepuffers nach vorne und füllt ihn wieder auf.
+------------------------------------------------------------------------------*/
+void refill(Input* in) {
+  if (in->eof) {
+    return;
+  }
+  memmove(in->data, in->data + in->pos, in->fill - in->pos);
+  in->fill -= in->pos;
+  in->pos = 0;
+  while (in->fill < BUFFER_SIZE && !in->eof) {
+    size_t size = fread(in->data + in->fill, 1, BUFFER_SIZE - in->fill, in->file);
+    if (size == 0) {
+      if (ferror(in->file)) {
+        perror("input error");
+        exit(3);
+      }
+      in->eof = 1;
+    }
+    in->fill += size;
+  }
+  memset(in->data + in->fill, 0, BUFFER_RESERVE);
+}
+
+/*------------------------------------------------------------------------------
+  Liest 8 Bytes little-endian ab pos.
+------------------------------------------------------------------------------*/
+uint64 get_uint64(const uint8* pos) {
+  uint64 x = 0;
+  for (int i = 7; i >= 0; i--) {
+    x = x << 8 | pos[i];
+  }
+  return x;
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt x als Dezimalzahl ab pos, je zwei Ziffern auf einmal.
+  Zurückgegeben wird die Position hinter der letzten Ziffer.
+------------------------------------------------------------------------------*/
+char* format_number(char* pos, uint64 x) {
+  uint32 length = 1;
+  for (uint64 y = x; y >= 10; y /= 10) {
+    length += 1;
+  }
+
+  char* end = pos + length;
+  while (x >= 100) {
+    uint32 pair = (uint32) (x % 100);
+    x /= 100;
+    pos[--length] = digit_pairs[2 * pair + 1];
+    pos[--length] = digit_pairs[2 * pair];
+  }
+  if (x >= 10) {
+    pos[1] = digit_pairs[2 * x + 1];
+    pos[0] = digit_pairs[2 * x];
+  } else {
+    pos[0] = (char) ('0' + x);
+  }
+  return end;
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt einen Puffer nach stdout.
+------------------------------------------------------------------------------*/
+void write_output(char* buffer, size_t size) {
+  if (fwrite(buffer, 1, size, stdout) != size || fflush(stdout) != 0) {
+    perror("output error");
+    exit(5);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Bricht bei einer fehlerhaften Eingabe ab.
+------------------------------------------------------------------------------*/
+void format_error(void) {
+  fprintf(stderr, "format error: not a complete primes -b file\n");
+  exit(4);
+}
+
+/*------------------------------------------------------------------------------
+  convert a string to an unsigned long integer
+------------------------------------------------------------------------------*/
+uint64 atoul(const char* str) {
+  uint64 ull = 0;
+
+  while (*str != 0) {
+    if ((*str < '0' || *str > '9')
+      || ull > 1844674407370955161ULL
+      || (ull *= 10) > 18446744073709551615ULL - (*str - '0')) {
+      return 0;
+    }
+    ull += (*str++ - '0');
+  }
+  return ull;
+}
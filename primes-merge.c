@@ -0,0 +1,486 @@
+/*------------------------------------------------------------------------------
+  P R I M E S - M E R G E . C
+
+  Zusammensetzen der Ausgaben der Teilbereiche von primes --shard i/N
+
+  Aufruf: primes-merge Manifest-Datei Ausgabe-Datei [Manifest-Datei Ausgabe-Datei ...]
+
+  Je Teilbereich werden sein Manifest und die Datei mit seiner Ausgabe
+  angegeben, in beliebiger Reihenfolge, aber alle N (mit demselben Bereich und
+  Format). Die Nummern eines Teilbereichs mit "serials local" erhöhen sich um
+  die Summe der "last" der Teilbereiche davor; der erste nummeriert bereits
+  wie primes ohne --shard.
+
+  Text wird mit korrigierten Nummern aneinandergehängt nach stdout geschrieben,
+  mit -p (ohne Nummern) unverändert, mit --count die Zusammenfassung über alle
+  Teilbereiche. Dateien im Binärformat (-b) bleiben getrennt, da jede ihren
+  eigenen Index hat: die Nummern in Kopf und Index werden an Ort und Stelle
+  korrigiert und das Manifest danach auf "serials absolute" umgestellt, ein
+  zweiter Aufruf ändert also nichts mehr. primes-decode liest die Dateien dann
+  einzeln mit den richtigen Nummern.
+
+  Die Formate sind im Kopf von primes.c beschrieben.
+
+  Compile: cc -O2 -o primes-merge primes-merge.c
+     oder: cl /nologo /O2 /Fe: primes-merge.exe primes-merge.c
+------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+/*------------------------------------------------------------------------------
+  Datentypen
+------------------------------------------------------------------------------*/
+typedef unsigned long long int uint64;
+typedef unsigned int           uint32;
+typedef unsigned char          uint8;
+
+typedef struct {
+  const char* manifest;
+  const char* file_name;
+  uint32 shard;
+  uint32 shards_count;
+  uint64 range_start;
+  uint64 range_end;
+  char   format[8];           /* text, plain, binary oder count */
+  int    local;               /* Nummern ab 1 statt ab pi(n_start - 1) + 1 */
+  uint64 last;                /* letzte vergebene Nummer */
+  uint64 offset;              /* Korrektur der Nummern */
+} Shard;
+
+#define BUFFER_SIZE         (1 << 20)
+#define HEADER_SIZE         32
+#define FOOTER_SIZE         40
+#define INDEX_ENTRY_SIZE    24
+#define INDEX_BLOCK_SIZE    4096        /* Index-Einträge je Lese-/Schreibvorgang */
+#define OUTPUT_LINE_SIZE    64
+
+/*------------------------------------------------------------------------------
+  Prototypen
+------------------------------------------------------------------------------*/
+Shard* get_shards(int argc, char** argv, uint32* shards_count);
+void read_manifest(Shard* shard);
+void write_manifest(const Shard* shard);
+int compare_shards(const void* a, const void* b);
+void copy_file(const Shard* shard);
+void renumber_text(const Shard* shard);
+void merge_counts(const Shard* shards, uint32 shards_count);
+void renumber_binary(const Shard* shard);
+uint64 get_uint64(const uint8* pos);
+void put_uint64(uint8* pos, uint64 x);
+char* format_number(char* pos, uint64 x);
+void write_output(const char* buffer, size_t size);
+void input_error(const char* file_name);
+void format_error(const char* file_name);
+uint64 atoul(const char* str);
+
+/*------------------------------------------------------------------------------
+  globale Variablen
+------------------------------------------------------------------------------*/
+const char digit_pairs[201] = "00010203040506070809101112131415161718192021222324"
+                              "25262728293031323334353637383940414243444546474849"
+                              "50515253545556575859606162636465666768697071727374"
+                              "75767778798081828384858687888990919293949596979899";
+
+/*------------------------------------------------------------------------------
+  Beginn der Verarbeitung
+------------------------------------------------------------------------------*/
+int main(int argc, char* argv[]) {
+  uint32 shards_count;
+  Shard* shards = get_shards(argc, argv, &shards_count);
+
+  /* Summe der "last" davor; ein schon absolut nummerierter Teilbereich
+     setzt sie auf seine eigene letzte Nummer */
+  uint64 serials = 0;
+  for (uint32 i = 0; i < shards_count; i++) {
+    shards[i].offset = shards[i].local ? serials : 0;
+    serials = shards[i].offset + shards[i].last;
+  }
+
+#ifdef _WIN32
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  if (strcmp(shards[0].format, "count") == 0) {
+    merge_counts(shards, shards_count);
+  }
+  for (uint32 i = 0; i < shards_count; i++) {
+    if (strcmp(shards[i].format, "binary") == 0) {
+      renumber_binary(&shards[i]);
+    } else if (strcmp(shards[i].format, "text") == 0 && shards[i].offset > 0) {
+      renumber_text(&shards[i]);
+    } else if (strcmp(shards[i].format, "count") != 0) {
+      copy_file(&shards[i]);
+    }
+  }
+  free(shards);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+  Liest die Manifeste aus den Kommandozeilen-Parametern, prüft, ob sie
+  zusammenpassen, und sortiert die Teilbereiche.
+------------------------------------------------------------------------------*/
+Shard* get_shards(int argc, char** argv, uint32* shards_count) {
+  if (argc < 3 || argc % 2 == 0) {
+    fprintf(stderr, "usage: primes-merge Manifest-File Shard-File [Manifest-File Shard-File ...]\n"
+                    "  Manifest-File      written by primes --shard i/N\n"
+                    "  Shard-File         the output of the same primes run\n");
+    exit(1);
+  }
+
+  *shards_count = (uint32) (argc - 1) / 2;
+  Shard* shards = malloc(*shards_count * sizeof(Shard));
+  if (shards == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  for (uint32 i = 0; i < *shards_count; i++) {
+    shards[i].manifest = argv[1 + 2 * i];
+    shards[i].file_name = argv[2 + 2 * i];
+    read_manifest(&shards[i]);
+  }
+  qsort(shards, *shards_count, sizeof(Shard), compare_shards);
+
+  for (uint32 i = 0; i < *shards_count; i++) {
+    if (   shards[i].shards_count != *shards_count || shards[i].shard != i + 1
+        || shards[i].range_start != shards[0].range_start || shards[i].range_end != shards[0].range_end
+        || strcmp(shards[i].format, shards[0].format) != 0) {
+      fprintf(stderr, "%s: shard does not fit (expected %u shards of the same range and format)\n",
+              shards[i].manifest, *shards_count);
+      exit(4);
+    }
+  }
+  return shards;
+}
+
+/*------------------------------------------------------------------------------
+  Liest ein Manifest (Format siehe primes.c).
+------------------------------------------------------------------------------*/
+void read_manifest(Shard* shard) {
+  FILE* file = fopen(shard->manifest, "r");
+  char serials[16];
+
+  if (file == NULL) {
+    input_error(shard->manifest);
+  }
+  if (   fscanf(file, "PRIMESHARD shard %u %u range %llu %llu format %7s serials %15s last %llu",
+                &shard->shard, &shard->shards_count, &shard->range_start, &shard->range_end,
+                shard->format, serials, &shard->last) != 7
+      || strcmp(serials, "local") != 0 && strcmp(serials, "absolute") != 0) {
+    format_error(shard->manifest);
+  }
+  shard->local = (strcmp(serials, "local") == 0);
+  fclose(file);
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt ein Manifest neu, über eine temporäre Datei, die dann umbenannt wird.
+------------------------------------------------------------------------------*/
+void write_manifest(const Shard* shard) {
+  char temp_name[4096];
+
+  if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", shard->manifest) >= (int) sizeof(temp_name)) {
+    fprintf(stderr, "%s: file name too long\n", shard->manifest);
+    exit(5);
+  }
+  FILE* file = fopen(temp_name, "w");
+  if (   file == NULL
+      || fprintf(file, "PRIMESHARD\nshard %u %u\nrange %llu %llu\nformat %s\nserials %s\nlast %llu\n",
+                 shard->shard, shard->shards_count, shard->range_start, shard->range_end,
+                 shard->format, shard->local ? "local" : "absolute", shard->last) < 0
+      || fclose(file) != 0) {
+    perror(temp_name);
+    exit(5);
+  }
+#ifdef _WIN32
+  if (!MoveFileExA(temp_name, shard->manifest, MOVEFILE_REPLACE_EXISTING)) {
+#else
+  if (rename(temp_name, shard->manifest) != 0) {
+#endif
+    perror(shard->manifest);
+    exit(5);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Vergleicht zwei Teilbereiche nach ihrer Nummer (für qsort).
+------------------------------------------------------------------------------*/
+int compare_shards(const void* a, const void* b) {
+  uint32 shard_a = ((const Shard*) a)->shard;
+  uint32 shard_b = ((const Shard*) b)->shard;
+  return (shard_a > shard_b) - (shard_a < shard_b);
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt die Ausgabe eines Teilbereichs unverändert nach stdout.
+------------------------------------------------------------------------------*/
+void copy_file(const Shard* shard) {
+  FILE* file = fopen(shard->file_name, "rb");
+  char* buffer = malloc(BUFFER_SIZE);
+  size_t size;
+
+  if (buffer == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  if (file == NULL) {
+    input_error(shard->file_name);
+  }
+  while ((size = fread(buffer, 1, BUFFER_SIZE, file)) > 0) {
+    write_output(buffer, size);
+  }
+  if (ferror(file)) {
+    input_error(shard->file_name);
+  }
+  fclose(file);
+  free(buffer);
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt die Zeilen "Nummer. prime = Primzahl" eines Teilbereichs mit um
+  shard->offset erhöhter Nummer nach stdout.
+------------------------------------------------------------------------------*/
+void renumber_text(const Shard* shard) {
+  FILE* file = fopen(shard->file_name, "rb");
+  char* output = malloc(BUFFER_SIZE);
+  char* pos = output;
+  char* end = output + BUFFER_SIZE - 2 * OUTPUT_LINE_SIZE;
+  char line[OUTPUT_LINE_SIZE];
+
+  if (output == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  if (file == NULL) {
+    input_error(shard->file_name);
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char* dot = strchr(line, '.');
+    size_t length = strlen(line);
+    if (dot == NULL || line[length - 1] != '\n') {
+      format_error(shard->file_name);
+    }
+    *dot = 0;
+    uint64 serial = atoul(line);
+    if (serial == 0) {
+      format_error(shard->file_name);
+    }
+    pos = format_number(pos, serial + shard->offset);
+    *pos++ = '.';
+    memcpy(pos, dot + 1, line + length - dot - 1);
+    pos += line + length - dot - 1;
+    if (pos >= end) {
+      write_output(output, pos - output);
+      pos = output;
+    }
+  }
+  if (ferror(file)) {
+    input_error(shard->file_name);
+  }
+  write_output(output, pos - output);
+  fclose(file);
+  free(output);
+}
+
+/*------------------------------------------------------------------------------
+  Fasst die Ausgaben von primes --count aller Teilbereiche zusammen: Anzahl
+  sowie erste und letzte Primzahl mit ihrer Nummer.
+------------------------------------------------------------------------------*/
+void merge_counts(const Shard* shards, uint32 shards_count) {
+  uint64 total = 0;
+  uint64 first_serial = 0, first_prime = 0, last_serial = 0, last_prime = 0;
+
+  for (uint32 i = 0; i < shards_count; i++) {
+    FILE* file = fopen(shards[i].file_name, "r");
+    uint64 count, serial, prime;
+
+    if (file == NULL) {
+      input_error(shards[i].file_name);
+    }
+    if (fscanf(file, "%llu primes", &count) != 1) {
+      format_error(shards[i].file_name);
+    }
+    if (count > 0) {
+      if (fscanf(file, " first: %llu. prime = %llu", &serial, &prime) != 2) {
+        format_error(shards[i].file_name);
+      }
+      if (total == 0) {
+        first_serial = serial + shards[i].offset;
+        first_prime = prime;
+      }
+      if (fscanf(file, " last: %llu. prime = %llu", &last_serial, &last_prime) != 2) {
+        format_error(shards[i].file_name);
+      }
+      last_serial += shards[i].offset;
+    }
+    total += count;
+    fclose(file);
+  }
+
+  printf("%llu primes\n", total);
+  if (total > 0) {
+    printf("first: %llu. prime = %llu\n", first_serial, first_prime);
+    printf("last: %llu. prime = %llu\n", last_serial, last_prime);
+  }
+  if (fflush(stdout) != 0) {
+    perror("output error");
+    exit(5);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Erhöht die Nummern in Kopf und Index einer Datei im Binärformat an Ort und
+  Stelle um shard->offset und stellt das Manifest auf "absolute" um.
+------------------------------------------------------------------------------*/
+void renumber_binary(const Shard* shard) {
+  uint8 header[HEADER_SIZE];
+  uint8 footer[FOOTER_SIZE];
+
+  if (shard->offset == 0) {
+    return;
+  }
+  FILE* file = fopen(shard->file_name, "r+b");
+  if (file == NULL) {
+    input_error(shard->file_name);
+  }
+  if (   fread(header, 1, HEADER_SIZE, file) != HEADER_SIZE || memcmp(header, "PRIMEGAP", 8) != 0
+      || fseek64(file, -FOOTER_SIZE, SEEK_END) != 0
+      || fread(footer, 1, FOOTER_SIZE, file) != FOOTER_SIZE || memcmp(footer + 32, "PRIMEEND", 8) != 0) {
+    format_error(shard->file_name);
+  }
+
+  /* leere Ausgabe: Nummer 0, kein Index */
+  if (get_uint64(header + 8) != 0) {
+    put_uint64(header + 8, get_uint64(header + 8) + shard->offset);
+    if (fseek64(file, 0, SEEK_SET) != 0 || fwrite(header, 1, HEADER_SIZE, file) != HEADER_SIZE) {
+      input_error(shard->file_name);
+    }
+  }
+
+  uint64 index_offset = get_uint64(footer + 16);
+  uint64 index_count = get_uint64(footer + 24);
+  uint8* index = malloc(INDEX_BLOCK_SIZE * INDEX_ENTRY_SIZE);
+  if (index == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  for (uint64 i = 0; i < index_count; i += INDEX_BLOCK_SIZE) {
+    size_t count = (index_count - i < INDEX_BLOCK_SIZE) ? (size_t) (index_count - i) : INDEX_BLOCK_SIZE;
+    uint64 offset = index_offset + i * INDEX_ENTRY_SIZE;
+    if (   fseek64(file, offset, SEEK_SET) != 0
+        || fread(index, INDEX_ENTRY_SIZE, count, file) != count) {
+      format_error(shard->file_name);
+    }
+    for (size_t j = 0; j < count; j++) {
+      put_uint64(index + j * INDEX_ENTRY_SIZE, get_uint64(index + j * INDEX_ENTRY_SIZE) + shard->offset);
+    }
+    if (   fseek64(file, offset, SEEK_SET) != 0
+        || fwrite(index, INDEX_ENTRY_SIZE, count, file) != count) {
+      input_error(shard->file_name);
+    }
+  }
+  free(index);
+  if (fclose(file) != 0) {
+    input_error(shard->file_name);
+  }
+
+  Shard renumbered = *shard;
+  renumbered.local = 0;
+  renumbered.last += shard->offset;
+  write_manifest(&renumbered);
+}
+
+/*------------------------------------------------------------------------------
+  Liest bzw. schreibt 8 Bytes little-endian ab pos.
+------------------------------------------------------------------------------*/
+uint64 get_uint64(const uint8* pos) {
+  uint64 x = 0;
+  for (int i = 7; i >= 0; i--) {
+    x = x << 8 | pos[i];
+  }
+  return x;
+}
+
+void put_uint64(uint8* pos, uint64 x) {
+  for (int i = 0; i < 8; i++) {
+    *pos++ = (uint8) (x >> 8 * i);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt x als Dezimalzahl ab pos, je zwei Ziffern auf einmal.
+  Zurückgegeben wird die Position hinter der letzten Ziffer.
+------------------------------------------------------------------------------*/
+char* format_number(char* pos, uint64 x) {
+  uint32 length = 1;
+  for (uint64 y = x; y >= 10; y /= 10) {
+    length += 1;
+  }
+
+  char* end = pos + length;
+  while (x >= 100) {
+    uint32 pair = (uint32) (x % 100);
+    x /= 100;
+    pos[--length] = digit_pairs[2 * pair + 1];
+    pos[--length] = digit_pairs[2 * pair];
+  }
+  if (x >= 10) {
+    pos[1] = digit_pairs[2 * x + 1];
+    pos[0] = digit_pairs[2 * x];
+  } else {
+    pos[0] = (char) ('0' + x);
+  }
+  return end;
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt einen Puffer nach stdout.
+------------------------------------------------------------------------------*/
+void write_output(const char* buffer, size_t size) {
+  if (fwrite(buffer, 1, size, stdout) != size || fflush(stdout) != 0) {
+    perror("output error");
+    exit(5);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Bricht bei einem Fehler beim Lesen (bzw. Korrigieren) einer Datei ab.
+------------------------------------------------------------------------------*/
+void input_error(const char* file_name) {
+  perror(file_name);
+  exit(3);
+}
+
+/*------------------------------------------------------------------------------
+  Bricht bei einer fehlerhaften Datei ab.
+------------------------------------------------------------------------------*/
+void format_error(const char* file_name) {
+  fprintf(stderr, "%s: format error: not a complete primes --shard file\n", file_name);
+  exit(4);
+}
+
+/*------------------------------------------------------------------------------
+  convert a string to an unsigned long integer
+------------------------------------------------------------------------------*/
+uint64 atoul(const char* str) {
+  uint64 ull = 0;
+
+  while (*str != 0) {
+    if ((*str < '0' || *str > '9')
+      || ull > 1844674407370955161ULL
+      || (ull *= 10) > 18446744073709551615ULL - (*str - '0')) {
+      return 0;
+    }
+    ull += (*str++ - '0');
+  }
+  return ull;
+}
@@ -6,82 +6,730 @@
   Wenn nur ein Argument (n) angegeben wird, dann werden alle Primzahlen zwischen
   1 und n ausgegeben.
 
-  Aufruf: primes [Von-Zahl (> 0)] Bis-Zahl (> 0)
+  Aufruf: primes [-s Sieb-Größe (KiB)] [-j Threads] [-p] [-b] [-z] [--count]
+                 [--stats] [-i Index-Datei] [--checkpoint Datei [--resume]]
+                 [Von-Zahl (> 0)] Bis-Zahl (> 0)
+     oder: primes [-s Sieb-Größe (KiB)] [--stats] -w Index-Datei Bis-Zahl (> 0)
+     oder: primes -F Primfaktor-Datei
+     oder: primes [-s Sieb-Größe (KiB)] [-p] [-b] [--stats] --nth k
+     oder: primes --is-prime < Zahlen
+     oder: primes [-s Sieb-Größe (KiB)] [-j Threads] --server [Socket-Datei]
+     oder: primes [Optionen] --shard i/N Manifest-Datei [Von-Zahl] Bis-Zahl
 
-  Compile: cc -O2 -o primes primes.c -lm
-     oder: cl /nologo /O2 /Fe: primes.exe primes.c
+  Ohne -s richtet sich die Größe eines Siebsegments nach dem L2- (bzw. L1d-)
+  Cache, sie ist damit unabhängig von n. Sie wird auf eine Potenz von 2
+  abgerundet.
+
+  Mit -j werden die Segmente von mehreren Threads parallel gesiebt und gezählt.
+  Die Ausgabe ist dieselbe wie ohne -j. Ohne -j laufen, sofern es mehrere
+  Prozessoren gibt, Sieben, Formatieren und Schreiben als Pipeline in je einem
+  eigenen Thread.
+
+  Mit -p werden nur die Primzahlen selbst ausgegeben (ohne "Nummer. prime = ").
+  Mit -z wird unter Linux in eine Pipe per vmsplice ohne Kopieren geschrieben;
+  das setzt voraus, dass der Leser die Daten kopiert (read) und nicht spliced.
+
+  Mit -b wird statt Text ein kompaktes Binärformat ausgegeben, das mit
+  primes-decode wieder gelesen werden kann (alle Zahlen little-endian):
+
+    Kopf (32 Bytes):    "PRIMEGAP", Nummer und Wert der ersten Primzahl,
+                        Index-Abstand K (uint32), 0 (uint32)
+    Daten:              je Primzahl der Abstand zur vorigen als Varint
+                        (7 Bit je Byte, niedrigste zuerst) mit dem Wert
+                        Abstand / 2 (von 2 nach 3: 1), danach ein Byte 0
+    Index:              für jede K-te Primzahl ab der ersten deren Nummer,
+                        Wert und die Position des folgenden Abstands (je uint64)
+    Ende (40 Bytes):    Anzahl der Primzahlen, letzte Primzahl, Position und
+                        Anzahl der Index-Einträge, "PRIMEEND"
+
+  Da Primzahl-Abstände unter 2^64 kleiner als 1600 sind, braucht eine Primzahl
+  höchstens 2 Bytes, bis etwa 10^12 fast immer nur 1 Byte.
+
+  Mit --count (oder -c) werden die Primzahlen nicht ausgegeben, sondern nur
+  gezählt, segmentweise per popcount direkt im Sieb. Ausgegeben werden dann
+  deren Anzahl sowie die erste und letzte Primzahl mit ihrer Nummer.
+
+  Ist n_start groß genug, dann wird nicht ab 1 gesiebt: die Anzahl der
+  Primzahlen < n_start wird mit dem Verfahren von Lagarias, Miller und Odlyzko
+  in etwa O(n_start^(2/3)) berechnet, gesiebt werden nur die Primfaktoren bis
+  sqrt(n) und der Bereich von n_start bis n. Mit -p (ohne -b und -c) gibt es
+  keine Nummern, pi(n_start - 1) wird dann gar nicht erst berechnet.
+
+  Praktisch reicht das bis etwa 10^16: pi(10^15) dauert auf einem Kern etwa
+  30 s, pi(10^16) gut 2 min, und je Zehnerpotenz wird es knapp fünfmal
+  langsamer, bei 10^18 also rund eine Stunde, nahe 2^64 mehrere Stunden. Für
+  so große n_start bleiben -p oder eine Index-Datei.
+
+  Schneller geht es mit einer Index-Datei (-i), die pi(k * 2^32) für k = 0, 1,
+  ... enthält: gesiebt wird dann erst ab dem letzten Stützpunkt <= n_start,
+  sofern das nicht länger dauert als LMO. Das ist etwa so, solange der Abstand
+  höchstens 2^27 + n_start^(2/3) beträgt; bei größerem wird doch gezählt.
+  Mit -w wird eine Index-Datei bis n erstellt bzw. ab ihrem letzten Stützpunkt
+  bis n fortgesetzt; sie kann so in mehreren Läufen gefüllt werden.
+
+    Kopf (16 Bytes):    "PRIMEPI1", Abstand der Stützpunkte (uint64)
+    Daten:              pi(k * Abstand) für k = 0, 1, ... (je uint64)
+
+  Mit --nth wird nur die k-te Primzahl ausgegeben (k <= pi(2^64 - 1)). Statt
+  bis dorthin zu sieben, wird sie mit der Umkehrung der Riemannschen Funktion
+  R(x) genähert, pi kurz davor genau gezählt und der Rest gesiebt.
+  Die Laufzeit ist damit die von pi an dieser Stelle, also weit mehr als ein
+  paar Sekunden; gemessen (Wanduhr, ein Kern): 13 s für k = 10^13, 59 s für
+  k = 10^14, 4,4 min für k = 10^15 und 31 min für k = 10^16.
+
+  Mit --is-prime werden die (durch Leerraum getrennten) Zahlen von stdin
+  einzeln geprüft, ohne Sieb per deterministischem Miller-Rabin-Test; je Zahl
+  wird "n is prime" bzw. "n is not prime" ausgegeben, für alles andere an
+  dessen Stelle "error: invalid number ..." (der Exit-Code ist dann 1).
+  Derselbe Test ersetzt mit -p (ohne -b und -c) das Sieb, wenn der Bereich von
+  n_start bis n schmal ist gegenüber sqrt(n): die Primfaktoren bis sqrt(n) zu
+  sieben, kostete dann mehr als alle Kandidaten zu prüfen.
+
+  Mit --server werden die Primfaktoren bis 2^32 einmal berechnet und bleiben
+  für beliebig viele Anfragen im Speicher; jede Anfrage siebt dann nur noch
+  ihren eigenen Bereich. Die Anfragen kommen zeilenweise von stdin oder, unter
+  POSIX, über ein Unix-Domain-Socket, dessen Verbindungen von -j Threads
+  gleichzeitig bedient werden:
+
+    range m n           die Primzahlen von m bis n, je eine Zeile
+    count m n           deren Anzahl
+    nth k               die k-te Primzahl
+
+  Jede Antwort endet mit einer Leerzeile, ein Fehler wird als "error: ..."
+  gemeldet.
+
+  Die Primfaktoren bis sqrt(n) werden bei jedem Aufruf neu gesiebt, bis 2^32
+  sind das rund 203 Mio. Mit -F werden sie einmalig in eine Datei geschrieben,
+  die dann mit -f (in allen Modi) in den Speicher abgebildet und statt des
+  Siebens nur noch dekodiert wird; die Seiten teilen sich gleichzeitig
+  laufende Prozesse. Die Abstände zwischen ungeraden Primzahlen unter 2^32 sind
+  höchstens 336, halbiert passen sie also in ein Byte:
+
+    Kopf (24 Bytes):    "PRIMEBAS", Anzahl der Primzahlen, größte Primzahl
+    Daten:              je Primzahl ab 7 der halbe Abstand zur vorigen (1 Byte)
+
+  Mit --shard i/N wird nur der i-te von N Teilbereichen von n_start bis n
+  berechnet, etwa auf verschiedenen Rechnern. Die Grenzen sind Vielfache von
+  30 * 2^18 (ein Segment der größten Sieb-Größe), die Teilbereiche bis auf den
+  letzten gleich groß. Nur der erste nummeriert wie ohne --shard ab
+  pi(n_start - 1) + 1; die anderen (und mit -p alle) nummerieren ab 1, brauchen
+  also kein pi und nichts voneinander. Am Ende wird ein Manifest geschrieben:
+
+    PRIMESHARD
+    shard i N
+    range n_start n
+    format text|plain|binary|count
+    serials absolute|local
+    last Nummer         letzte vergebene Nummer (bei local: Anzahl)
+
+  primes-merge setzt die Ausgaben anhand der Manifeste wieder zusammen: die
+  Nummern eines Teilbereichs erhöhen sich um die Summe der "last" davor.
+
+  Mit --checkpoint wird etwa jede Minute zwischen zwei Segmenten der Stand in
+  die Datei geschrieben (erst in eine temporäre, die dann umbenannt wird), und
+  zwar nachdem die Ausgabe bis dorthin auf der Platte ist; nach dem Ende wird
+  die Datei wieder gelöscht. Die Ausgabe muss dafür (außer mit --count) eine
+  Datei sein. Mit --resume wird ein abgebrochener Lauf mit denselben Optionen
+  beim letzten Checkpoint fortgesetzt: die Ausgabe wird auf den Stand des
+  Checkpoints gekürzt und ergibt am Ende dieselben Bytes wie ein Lauf in einem
+  Stück; ohne Checkpoint beginnt der Lauf mit leerer Ausgabe von vorn. Die
+  Ausgabe ist dabei mit ">>" oder "1<>" statt mit ">" umzuleiten.
+
+    Kopf (104 Bytes):   "PRIMECKP", n_start, n, Format (0: Text, 1: -p,
+                        2: -b, 3: --count), nächstes Byte des Siebs (Zahl / 30),
+                        Anzahl der Primzahlen bis dorthin, Länge der Ausgabe,
+                        Anzahl, letzte Primzahl, Nummer und Wert der ersten,
+                        Nummer der letzten ausgegebenen Primzahl, Anzahl der
+                        Index-Einträge des Binärformats (je uint64)
+    Index:              deren Nummer, Wert und Position (je uint64)
+
+  Mehr braucht es nicht: das Sieb baut die Vielfachen und Buckets ab jedem
+  Segment selbst neu auf, wie für die Abschnitte der Threads (-j).
+
+  Mit --stats wird am Ende auf stderr ausgegeben, wie sich der Lauf auf die
+  Phasen verteilt: Berechnung der Primfaktoren bis sqrt(n), pi(n_start - 1),
+  Sieben der Segmente, Auswerten der Segmente und Schreiben der Ausgabe. Je
+  Phase gibt es die Zeit und die Anzahl der dabei gezählten Primzahlen, für das
+  Sieben auch die Anzahl der Segmente und der gestrichenen Vielfachen. Unter
+  Linux kommen, soweit perf_event_open erlaubt ist, Takte, Befehle, L1d- und
+  LLC-Misses sowie falsch vorhergesagte Sprünge hinzu. Mit -j ist "sieve" die
+  Zeit, die auf die Threads gewartet wird; deren Zähler landen ebenfalls dort.
+
+  Das Sieben und Zählen selbst steckt in libprimes.c (siehe libprimes.h).
+
+  Compile: cc -O2 -o primes primes.c libprimes.c -lm -lpthread
+     oder: cl /nologo /O2 /Fe: primes.exe primes.c libprimes.c
 ------------------------------------------------------------------------------*/
+#ifdef __linux__
+#define _GNU_SOURCE  /* vmsplice, F_SETPIPE_SZ */
+#endif
+
+#include <inttypes.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "libprimes-internal.h"
 
 /*------------------------------------------------------------------------------
   Datentypen
 ------------------------------------------------------------------------------*/
-typedef unsigned long long int uint64;
-typedef unsigned int           uint32;
-
 typedef struct {
   uint64 n_start;
   uint64 n;
+  uint32 sieve_size;
+  uint32 threads_count;
+  int    plain;
+  int    binary;
+  int    zero_copy;
+  int    count_only;
+  int    stats;
+  int    is_prime;            /* Zahlen von stdin prüfen */
+  uint64 nth;                 /* nur die k-te Primzahl ausgeben */
+  int    server;              /* Anfragen von stdin bzw. server_socket beantworten */
+  const char* server_socket;
+  const char* index_file;     /* Index-Datei mit pi(k * 2^32) */
+  int    index_build;         /* Index-Datei erstellen bzw. fortsetzen */
+  const char* base_file;      /* Datei mit den Primfaktoren bis 2^32 */
+  int    base_build;          /* Primfaktor-Datei erstellen */
+  uint32 shard;               /* Teilbereich shard (ab 1) von shards_count, ... */
+  uint32 shards_count;        /* ... 0: ohne --shard */
+  const char* shard_manifest;
+  uint64 range_start;         /* ganzer Bereich aller Teilbereiche */
+  uint64 range_end;
+  const char* checkpoint_file;
+  int    resume;              /* beim Checkpoint fortsetzen */
 } Parameters;
 
+typedef struct {
+  const PrimeFactors* factors;
+  uint32  sieve_size;
+  uint64  from;
+  uint64  to;
+  uint64  low_byte;           /* Beginn des Abschnitts */
+  uint32  size;               /* Größe des Abschnitts (Vielfaches der Segmentgröße) */
+  uint8*  sieve;
+  uint64  count;              /* Anzahl der Primzahlen im Abschnitt */
+} Chunk;
+
+#define CHUNK_SEGMENTS_MAX    128   /* Segmente je Abschnitt (-j) */
+
+#define SERVER_LINE_SIZE      256
+#define SERVER_QUEUE_SIZE     64    /* angenommene, noch nicht bediente Verbindungen */
+
+typedef struct {
+  PrimeFactors factors;       /* Primfaktoren bis 2^32, von allen Anfragen geteilt */
+  uint32  sieve_size;
+#ifndef _WIN32
+  pthread_mutex_t lock;
+  pthread_cond_t  not_empty;
+  pthread_cond_t  not_full;
+  int     connections[SERVER_QUEUE_SIZE];
+  uint32  first;
+  uint32  count;
+#endif
+} Server;
+
+#define IS_PRIME_BATCH_SIZE   4096
+#define IS_PRIME_WINDOW_RATIO 16    /* Bereich < sqrt(n) / Faktor: Miller-Rabin */
+
+#define PI_JUMP_MIN           (1ULL << 24)  /* ab hier wird pi(n_start - 1) berechnet */
+#define PI_INDEX_DISTANCE_MIN (1ULL << 27)  /* + n_start^(2/3): vom Stützpunkt sieben statt LMO */
+#define PI_INDEX_HEADER_SIZE  16
+#define PI_INDEX_INTERVAL     (1ULL << 32)
+
+typedef struct {
+  const uint8* data;          /* Datei im Speicher (mmap) */
+  uint64 size;
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#endif
+} MappedFile;
+
+typedef struct {
+  MappedFile map;
+  uint64 interval;            /* Abstand der Stützpunkte */
+  uint64 count;               /* Anzahl der Stützpunkte */
+} PiIndex;
+
+#define BASE_FILE_HEADER_SIZE 24
+
+#define SHARD_ALIGNMENT       (30ULL << 18)  /* Grenzen der Teilbereiche */
+
+#define CHECKPOINT_HEADER_SIZE 104
+#define CHECKPOINT_INTERVAL   60.0  /* Sekunden */
+
+typedef struct {
+  const char* file;           /* NULL: ohne --checkpoint */
+  uint64 n_start;
+  uint64 n;
+  uint64 format;              /* 0: Text, 1: -p, 2: -b, 3: --count */
+  uint64 next_byte;           /* > 0: Fortsetzung ab diesem Byte (--resume) */
+  double due;                 /* Zeit des nächsten Checkpoints */
+} Checkpoint;
+
+#define OUTPUT_BUFFER_SIZE    (1 << 20)
+#define OUTPUT_BUFFERS_COUNT  4
+#define OUTPUT_LINE_SIZE      64
+
+#define BINARY_HEADER_SIZE    32
+#define BINARY_FOOTER_SIZE    40
+#define BINARY_INDEX_INTERVAL 65536
+
+typedef struct {
+  uint64 serial;
+  uint64 prime;
+  uint64 offset;              /* Position des Abstands zur nächsten Primzahl */
+} IndexEntry;
+
+/* Warteschlange zwischen genau einem Erzeuger und einem Verbraucher, ohne
+   Sperren: die Einträge selbst liegen in einem Ring daneben */
+typedef struct {
+  uint32 head;                /* Anzahl der eingestellten Einträge (Erzeuger) */
+  char   padding[60];         /* head und tail in verschiedenen Cache-Zeilen */
+  uint32 tail;                /* Anzahl der entnommenen Einträge (Verbraucher) */
+} Queue;
+
+typedef struct {
+  char*  buffers[OUTPUT_BUFFERS_COUNT];
+  uint32 buffer;              /* Index des aktuellen Puffers */
+  char*  pos;                 /* Schreibposition im aktuellen Puffer */
+  char*  end;                 /* ab hier passt evtl. keine Zeile mehr */
+  int    plain;               /* nur die Primzahlen ausgeben */
+  int    binary;              /* Binärformat (Abstände) ausgeben */
+  int    count_only;          /* nur zählen, nichts ausgeben */
+  int    zero_copy;           /* per vmsplice in eine Pipe schreiben */
+  uint64 written;             /* Anzahl der bereits geschriebenen Bytes */
+  uint64 count;               /* Anzahl der ausgegebenen Primzahlen */
+  uint64 last_prime;          /* zuletzt ausgegebene Primzahl */
+  uint64 first_serial;        /* Nummer und Wert der ersten ausgegebenen ... */
+  uint64 first_prime;
+  uint64 last_serial;         /* ... bzw. der letzten gezählten Primzahl */
+  IndexEntry* index;          /* Index des Binärformats */
+  uint32 index_count;
+  uint32 index_capacity;
+  uint64 serial;              /* Nummer, die in serial_digits steht */
+  char*  serial_first;        /* erste Ziffer der Nummer */
+  char   serial_digits[21];   /* Nummer rechtsbündig, davor Nullen */
+  int    pipelined;           /* volle Puffer an den Writer-Thread übergeben */
+  Queue  flushed;             /* volle Puffer (Eintrag i: Puffer i % Anzahl) */
+  uint32 sizes[OUTPUT_BUFFERS_COUNT];  /* deren Länge, 0: Ende */
+} Output;
+
+#define PIPELINE_SEGMENTS     4     /* gesiebte Segmente vor der Formatierung */
+
+typedef struct {
+  SegmentedSieve* s;
+  uint64 from;
+  uint64 n;
+  uint32 sieve_size;
+  uint8* segments[PIPELINE_SEGMENTS];
+  Queue  sieved;              /* gesiebte Segmente (Eintrag i: Segment i % Anzahl) */
+} Pipeline;
+
+#define PHASE_OTHER           0
+#define PHASE_BASE            1     /* Primfaktoren bis sqrt(n) */
+#define PHASE_PI              2     /* pi(n_start - 1) bzw. Index */
+#define PHASE_SIEVE           3
+#define PHASE_SCAN            4     /* Primzahlen aus den Segmenten holen */
+#define PHASE_OUTPUT          5
+#define PHASES_COUNT          6
+#define EVENTS_COUNT          5
+
+typedef struct {
+  double wall;
+  uint64 primes;
+  uint64 segments;
+  uint64 cross_offs;
+  uint64 events[EVENTS_COUNT];
+} Phase;
+
+typedef struct {
+  int    enabled;
+  uint32 phase;                     /* aktuelle Phase ... */
+  double start;                     /* ... und Zeit, Anzahl der Primzahlen und */
+  uint64 primes_start;              /* Zählerstände bei deren Beginn */
+  uint64 events_start[EVENTS_COUNT];
+  int    events_fd[EVENTS_COUNT];   /* perf_event_open, -1: nicht verfügbar */
+  int    events_error;              /* errno, wenn kein Zähler verfügbar ist */
+  Phase  phases[PHASES_COUNT];
+} Stats;
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef LPTHREAD_START_ROUTINE ThreadFunction;
+#define THREAD_FUNCTION DWORD WINAPI
+#else
+typedef pthread_t Thread;
+typedef void* (*ThreadFunction)(void*);
+#define THREAD_FUNCTION void*
+#endif
+
+/* Zugriff auf die Zähler einer Queue aus zwei Threads (MSVC: volatile hat
+   dort acquire/release-Semantik) */
+#ifdef _MSC_VER
+#define load_acquire(p)       (*(volatile uint32*) (p))
+#define store_release(p, x)   (*(volatile uint32*) (p) = (x))
+#else
+#define load_acquire(p)       __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, x)   __atomic_store_n(p, x, __ATOMIC_RELEASE)
+#endif
+
 /*------------------------------------------------------------------------------
   Prototypen
 ------------------------------------------------------------------------------*/
 Parameters get_parameters(int argc, char** argv);
-void print_primes(uint64 n);
+void select_shard(Parameters* p);
+void write_shard_manifest(const Parameters* p);
+void print_primes(const Parameters* p);
+void resume_primes(const Parameters* p);
 void print_prime(uint64 prime_number);
-uint32 calc_square_roots(uint64 n, uint32* sqrts);
-uint32* build_primes(uint32 prime_factors_count_estimated);
-char* build_sieve(uint32 sqrt_n);
-uint32 calc_prime_factors(uint32 sqrts_top, uint32* sqrts, uint32* primes, char* sieve);
-void calc_remaining_primes(uint64 n, uint32 sqrt_n, uint32 primes_top, uint32* primes, char* sieve);
+void print_nth_prime(const Parameters* p);
+void test_primes(uint64 from, uint64 n);
+uint32 next_candidates(uint64* base, uint64 from, uint64 n, uint64* numbers);
+uint64 check_primes(void);
+void init_output(const Parameters* p);
+void write_prime(uint64 serial, uint64 prime_number);
+void write_prime_binary(uint64 serial, uint64 prime_number);
+void count_prime(uint64 serial, uint64 prime_number);
+void add_index_entry(uint64 serial, uint64 prime_number, uint64 offset);
+void finish_output(void);
+char* put_uint64(char* pos, uint64 x);
+void set_serial(uint64 serial);
+char* format_number(char* pos, uint64 x);
+void flush_output(void);
+void write_buffer(char* buffer, size_t size);
+void calc_remaining_primes(uint64 from, uint64 n, const PrimeFactors* factors, uint8* sieve, uint32 sieve_size);
+void calc_remaining_primes_parallel(uint64 from, uint64 n, uint32 sqrt_n, const PrimeFactors* factors, uint32 sieve_size, uint32 threads_count);
+Chunk* build_chunks(uint32 chunks_count, uint32 chunk_size);
+uint32 start_chunks(Chunk* chunks, Thread* threads, uint32 threads_count, uint64* low_byte, uint64 last_byte, uint32 chunk_size);
+THREAD_FUNCTION sieve_chunk(void* arg);
+void start_thread(Thread* thread, ThreadFunction function, void* arg);
+void join_thread(Thread thread);
+void calc_remaining_primes_pipelined(uint64 from, uint64 n, SegmentedSieve* s, uint32 sieve_size);
+THREAD_FUNCTION sieve_segments(void* arg);
+THREAD_FUNCTION write_buffers(void* arg);
+void wait_for_entry(Queue* queue, uint32 entry);
+void wait_for_space(Queue* queue, uint32 capacity);
+void wait_a_moment(uint32* spins);
+void print_segment_primes(uint8* sieve, uint64 low_byte, uint32 size);
+void count_segment_output(uint8* sieve, uint64 low_byte, uint32 size, uint64 count);
+void open_checkpoint(const Parameters* p);
+void read_checkpoint(const char* file_name);
+void save_checkpoint(uint64 next_byte);
+void sync_file(FILE* file, const char* file_name);
+void checkpoint_error(const char* file_name);
+void open_pi_index(PiIndex* index, const char* file_name);
+uint64 lookup_pi_index(const PiIndex* index, uint64 x, uint64* checkpoint);
+void close_pi_index(PiIndex* index);
+void build_pi_index(const Parameters* p);
+void index_error(const char* file_name);
+int map_file(MappedFile* map, const char* file_name);
+void unmap_file(MappedFile* map);
+void get_prime_factors(const char* base_file, uint32 sqrts_top, uint32* sqrts, PrimeFactors* factors, uint8* sieve, uint32 sieve_size);
+void load_prime_factors(const char* base_file, uint32 sqrt_n, PrimeFactors* factors);
+void build_base_file(const Parameters* p);
+void base_file_error(const char* file_name);
+void run_server(const Parameters* p);
+void serve_connection(FILE* in, FILE* out, uint8* sieve);
+int answer_query(const char* line, FILE* out, uint8* sieve);
+uint64 sieve_window(uint64 from, uint64 to, uint8* sieve, FILE* out);
+int parse_number(const char* token, uint64* x);
+#ifndef _WIN32
+int open_server_socket(const char* path);
+void* serve_connections(void* arg);
+#endif
+void init_stats(int enabled);
+uint32 enter_phase(uint32 phase);
+void read_events(uint64* values);
+void count_sieve_work(uint64 low_byte, uint64 segments, const PrimeFactors* factors, uint32 sieve_size);
+uint64 count_coprime_to_30(uint64 x);
+void print_stats(void);
+double wall_clock(void);
+uint32 count_processors(void);
 uint64 atoul(const char* str);
-uint32 integer_square_root(uint64 x);
-uint32 estimate_number_of_primes_up_to(uint32 x);
 
 /*------------------------------------------------------------------------------
   globale Variablen
 ------------------------------------------------------------------------------*/
 uint64 n_start;
+uint64 primes_counted;  /* Anzahl der bisher gefundenen Primzahlen */
+Output output;
+Stats  stats;
+Server server;
+Checkpoint progress;
 
-/*------------------------------------------------------------------------------
-  Macros
-------------------------------------------------------------------------------*/
-#define odd(n) ((n - 1) | 1)
+const char* phase_names[PHASES_COUNT] = { "other", "base primes", "pi(n_start)", "sieve", "scan", "output" };
+const char* event_names[EVENTS_COUNT] = { "cycles", "instructions", "L1d-misses", "LLC-misses", "branch-misses" };
+
+const char digit_pairs[201] = "00010203040506070809101112131415161718192021222324"
+                              "25262728293031323334353637383940414243444546474849"
+                              "50515253545556575859606162636465666768697071727374"
+                              "75767778798081828384858687888990919293949596979899";
 
 /*------------------------------------------------------------------------------
   Beginn der Verarbeitung
 ------------------------------------------------------------------------------*/
 int main(int argc, char* argv[]) {
   Parameters p = get_parameters(argc, argv);
+  int status = 0;
   n_start = p.n_start;
-  print_primes(p.n);
-  return 0;
+  init_stats(p.stats);
+  init_output(&p);
+  if (p.checkpoint_file != NULL) {
+    open_checkpoint(&p);
+  }
+  if (p.index_build) {
+    build_pi_index(&p);
+  } else if (p.base_build) {
+    build_base_file(&p);
+  } else if (p.is_prime) {
+    status = (check_primes() > 0);
+  } else if (p.nth > 0) {
+    print_nth_prime(&p);
+    finish_output();
+  } else if (p.server) {
+    run_server(&p);
+  } else {
+    if (progress.next_byte > 0) {
+      resume_primes(&p);
+    } else {
+      print_primes(&p);
+    }
+    finish_output();
+    if (p.shards_count > 0) {
+      write_shard_manifest(&p);
+    }
+    if (p.checkpoint_file != NULL) {
+      remove(p.checkpoint_file);
+    }
+  }
+  if (p.stats) {
+    print_stats();
+  }
+  return status;
 }
 
 /*------------------------------------------------------------------------------
-  n_start und n aus den Kommandozeilen-Parametern ermitteln
+  Optionen, n_start und n aus den Kommandozeilen-Parametern ermitteln
 ------------------------------------------------------------------------------*/
 Parameters get_parameters(int argc, char** argv) {
   Parameters p;
+  int options_ok = 1;
+  char rest;
+
+  p.sieve_size = 0;
+  p.threads_count = 1;
+  p.plain = 0;
+  p.binary = 0;
+  p.zero_copy = 0;
+  p.count_only = 0;
+  p.stats = 0;
+  p.is_prime = 0;
+  p.nth = 0;
+  p.server = 0;
+  p.server_socket = NULL;
+  p.index_file = NULL;
+  p.index_build = 0;
+  p.base_file = NULL;
+  p.base_build = 0;
+  p.shard = 0;
+  p.shards_count = 0;
+  p.shard_manifest = NULL;
+  p.checkpoint_file = NULL;
+  p.resume = 0;
+  while (options_ok && argc > 1 && argv[1][0] == '-') {
+    uint64 value = (argc > 2) ? atoul(argv[2]) : 0;
+    int args_used = 2;
+    if (strcmp(argv[1], "-s") == 0 && value > 0 && value <= 256 * 1024) {
+      p.sieve_size = (uint32) value * 1024;
+    } else if (strcmp(argv[1], "-j") == 0 && value > 0 && value <= 1024) {
+      p.threads_count = (uint32) value;
+    } else if (strcmp(argv[1], "-p") == 0) {
+      p.plain = args_used = 1;
+    } else if (strcmp(argv[1], "-b") == 0) {
+      p.binary = args_used = 1;
+    } else if (strcmp(argv[1], "-z") == 0) {
+      p.zero_copy = args_used = 1;
+    } else if (strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "--count") == 0) {
+      p.count_only = args_used = 1;
+    } else if (strcmp(argv[1], "--stats") == 0) {
+      p.stats = args_used = 1;
+    } else if (strcmp(argv[1], "--is-prime") == 0) {
+      p.is_prime = args_used = 1;
+    } else if (strcmp(argv[1], "--nth") == 0 && value > 0 && value <= PI_MAX) {
+      p.nth = value;
+    } else if (strcmp(argv[1], "--server") == 0) {
+      p.server = 1;
+      if (argc > 2 && argv[2][0] != '-') {
+        p.server_socket = argv[2];
+      } else {
+        args_used = 1;
+      }
+    } else if ((strcmp(argv[1], "-i") == 0 || strcmp(argv[1], "-w") == 0) && argc > 2) {
+      p.index_file = argv[2];
+      p.index_build = (argv[1][1] == 'w');
+    } else if ((strcmp(argv[1], "-f") == 0 || strcmp(argv[1], "-F") == 0) && argc > 2) {
+      p.base_file = argv[2];
+      p.base_build = (argv[1][1] == 'F');
+    } else if (   strcmp(argv[1], "--shard") == 0 && argc > 3
+               && sscanf(argv[2], "%u/%u%c", &p.shard, &p.shards_count, &rest) == 2
+               && p.shard > 0 && p.shard <= p.shards_count) {
+      p.shard_manifest = argv[3];
+      args_used = 3;
+    } else if (strcmp(argv[1], "--checkpoint") == 0 && argc > 2) {
+      p.checkpoint_file = argv[2];
+    } else if (strcmp(argv[1], "--resume") == 0) {
+      p.resume = args_used = 1;
+    } else {
+      options_ok = 0;
+    }
+    argc -= args_used;
+    argv += args_used;
+  }
 
-  if (   argc != 2 && argc != 3
+  if ((p.is_prime || p.nth > 0 || p.server || p.base_build) && options_ok && argc == 1 && p.shards_count == 0
+      && p.checkpoint_file == NULL) {
+    p.n_start = p.n = 1;
+    return p;
+  }
+  if (   !options_ok
+      || p.is_prime || p.nth > 0 || p.server || p.base_build
+      || argc != 2 && argc != 3
+      || (argc == 3 || p.shards_count > 0 || p.checkpoint_file != NULL) && p.index_build
+      || p.resume && p.checkpoint_file == NULL
       || argc == 2 && (   (p.n_start = 1, p.n = atoul(argv[1])) < 1)
       || argc == 3 && (   (p.n_start =          atoul(argv[1])) < 1
                        || (               p.n = atoul(argv[2])) < 1)) {
-    fprintf(stderr, "usage: primes [From-Number (in (0,2^64))] To-Number (in (0..2^64))\n");
+    fprintf(stderr, "usage: primes [Options] [From-Number (in (0,2^64))] To-Number (in (0..2^64))\n"
+                    "  -s Sieve-Size-KiB  size of a sieve segment (in (0,2^18])\n"
+                    "  -j Threads         number of threads (in (0,1024])\n"
+                    "  -p                 print the prime numbers only\n"
+                    "  -b                 binary output (prime gaps, see primes-decode)\n"
+                    "  -z                 zero-copy output into a pipe (Linux)\n"
+                    "  -c, --count        count the prime numbers only\n"
+                    "  --stats            print time and counters per phase to stderr\n"
+                    "  -i Index-File      start counting at the nearest pi(k * 2^32) of the file\n"
+                    "  -w Index-File      build (or extend) the index file up to To-Number\n"
+                    "  -f Base-File       map the prime factors from the file instead of sieving them\n"
+                    "  -F Base-File       write the prime factors up to 2^32 to the file (no From/To-Number)\n"
+                    "  --nth k            print the k-th prime number only (no From/To-Number)\n"
+                    "                     (not fast for large k: measured 59 s for k = 10^14,\n"
+                    "                     4.4 min for k = 10^15 and 31 min for k = 10^16)\n"
+                    "  --is-prime         test the numbers read from stdin (no From/To-Number)\n"
+                    "  --server [Socket]  answer \"range m n\" / \"count m n\" / \"nth k\" queries from stdin\n"
+                    "                     or a Unix domain socket (-j connections at a time)\n"
+                    "  --shard i/N Manifest-File\n"
+                    "                     compute the i-th of N parts of the range only (see primes-merge)\n"
+                    "  --checkpoint File  save the progress to the file about once a minute\n"
+                    "  --resume           continue at the checkpoint (redirect the output with >> or 1<>)\n"
+                    "A From-Number above 2^24 first needs pi(From-Number - 1) (not with -p): about 30 s\n"
+                    "at 10^15, 2 min at 10^16, an hour at 10^18. Above 10^16 better use -p or -i.\n");
     exit(1);
   }
+  if (p.shards_count > 0) {
+    select_shard(&p);
+  }
   return p;
 }
 
+/*------------------------------------------------------------------------------
+  Beschränkt n_start und n auf den Teilbereich p->shard von p->shards_count.
+
+  Der Bereich wird ab dem Vielfachen von SHARD_ALIGNMENT <= n_start in gleich
+  große Teilbereiche (Vielfache von SHARD_ALIGNMENT) geteilt, der erste beginnt
+  bei n_start. Ist der Bereich dafür zu klein, dann bleiben die letzten leer.
+------------------------------------------------------------------------------*/
+void select_shard(Parameters* p) {
+  uint64 base = p->n_start - p->n_start % SHARD_ALIGNMENT;
+  uint64 span = p->n - base;                  /* Länge - 1, passt in 64 Bit */
+  uint64 size = span / p->shards_count + 1;
+  uint64 k = p->shard - 1;
+
+  p->range_start = p->n_start;
+  p->range_end = p->n;
+  if (p->shards_count == 1 || p->n < p->n_start) {
+    return;
+  }
+  size = (size + SHARD_ALIGNMENT - 1) / SHARD_ALIGNMENT * SHARD_ALIGNMENT;
+  if (k > span / size) {
+    p->n_start = 2;   /* leer */
+    p->n = 1;
+    return;
+  }
+  if (k > 0) {
+    p->n_start = base + k * size;
+  }
+  if (span - k * size >= size) {
+    p->n = base + k * size + size - 1;
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt das Manifest des Teilbereichs (siehe Kopf), erst in eine temporäre
+  Datei, die dann umbenannt wird: ein vorhandenes Manifest steht also immer für
+  eine vollständige Ausgabe.
+------------------------------------------------------------------------------*/
+void write_shard_manifest(const Parameters* p) {
+  char temp_name[4096];
+  const char* format = output.count_only ? "count" : output.binary ? "binary" : output.plain ? "plain" : "text";
+
+  if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", p->shard_manifest) >= (int) sizeof(temp_name)) {
+    fprintf(stderr, "%s: file name too long\n", p->shard_manifest);
+    exit(9);
+  }
+  FILE* file = fopen(temp_name, "w");
+  if (   file == NULL
+      || fprintf(file, "PRIMESHARD\nshard %u %u\nrange %" PRIu64 " %" PRIu64 "\nformat %s\nserials %s\nlast %" PRIu64 "\n",
+                 p->shard, p->shards_count, p->range_start, p->range_end, format,
+                 (p->shard == 1 && (output.binary || output.count_only || !output.plain)) ? "absolute" : "local", primes_counted) < 0
+      || fclose(file) != 0) {
+    perror(temp_name);
+    exit(9);
+  }
+#ifdef _WIN32
+  if (!MoveFileExA(temp_name, p->shard_manifest, MOVEFILE_REPLACE_EXISTING)) {
+#else
+  if (rename(temp_name, p->shard_manifest) != 0) {
+#endif
+    perror(p->shard_manifest);
+    exit(9);
+  }
+}
+
 /*------------------------------------------------------------------------------
   Gibt alle Primzahlen <= n aus.
 ------------------------------------------------------------------------------*/
-void print_primes(uint64 n) {
+void print_primes(const Parameters* p) {
+  uint64 n = p->n;
+
+  enter_phase(PHASE_BASE);
   if (n < 2) {
     return;
   }
@@ -90,18 +738,120 @@ void print_primes(uint64 n) {
   if (n < 3) {
     return;
   }
+  print_prime(3);
+
+  if (n < 5) {
+    return;
+  }
+  print_prime(5);
 
+  if (n < 7) {
+    return;
+  }
   uint32 sqrts[5];
-  uint32 sqrts_top = calc_square_roots(n, sqrts);
+  uint32 sqrts_top = primes_calc_square_roots(n, sqrts);
   uint32 sqrt_n = sqrts[0];
 
-  uint32 prime_factors_count_estimated = estimate_number_of_primes_up_to(sqrt_n);
+  /* schmaler Bereich ohne Nummern: jeden Kandidaten einzeln prüfen statt die
+     Primfaktoren bis sqrt(n) zu sieben */
+  if (   p->plain && !p->binary && !p->count_only
+      && n_start > 7 && n_start <= n && n - n_start < sqrt_n / IS_PRIME_WINDOW_RATIO) {
+    primes_counted -= 3;
+    enter_phase(PHASE_SIEVE);
+    test_primes(n_start, n);
+    enter_phase(PHASE_OTHER);
+    return;
+  }
+  primes_init_wheel();
+
+  uint32 prime_factors_count_estimated = primes_estimate_number_of_primes_up_to(sqrt_n);
+
+  PrimeFactors factors;
+  primes_build_prime_factors(&factors, prime_factors_count_estimated);
+  uint32 sieve_size = primes_calc_sieve_size(n, p->sieve_size);
+  uint8* sieve = primes_build_sieve(sieve_size);
+
+  get_prime_factors(p->base_file, sqrts_top, sqrts, &factors, sieve, sieve_size);
+
+  /* ab dem zweiten Teilbereich (--shard) und ohne Nummern (-p) zählen die
+     Primzahlen < n_start nicht mit: die Nummern beginnen bei 1 */
+  int local_serials = p->shard > 1 || p->plain && !p->binary && !p->count_only;
+  if (local_serials) {
+    uint32 below = (n_start - 1 < sqrt_n) ? (uint32) (n_start - 1) : sqrt_n;
+    primes_counted -= (n_start > 2) + (n_start > 3) + (n_start > 5) + primes_count_prime_factors_up_to(below, &factors);
+  }
+  for (uint32 i = 0, prime = 5; i < factors.count; i++) {
+    prime += 2 * factors.gaps[i];
+    print_prime(prime);
+  }
+
+  /* Primzahlen < n_start nicht alle sieben: ab dem letzten Stützpunkt des
+     Index <= n_start weitersieben, sofern das billiger ist als LMO (etwa so
+     viele Zahlen, wie in der Zeit von LMO gesiebt werden), sonst zählen */
+  uint64 from = sqrt_n + 1ULL;
+  if (n_start > from && local_serials) {
+    from = n_start;
+  } else if (n_start > from) {
+    enter_phase(PHASE_PI);
+    PiIndex index;
+    uint64 checkpoint = 0;
+    uint64 checkpoint_pi = 0;
+    if (p->index_file != NULL) {
+      open_pi_index(&index, p->index_file);
+      checkpoint_pi = lookup_pi_index(&index, n_start - 1, &checkpoint);
+    }
+    uint64 distance = n_start - checkpoint;
+    if (   checkpoint >= from
+        && (   n_start < PI_JUMP_MIN || distance <= PI_INDEX_DISTANCE_MIN
+            || distance <= pow((double) n_start, 2.0 / 3.0))) {
+      from = checkpoint + 1;
+      primes_counted = checkpoint_pi;
+    } else if (n_start >= PI_JUMP_MIN) {
+      from = n_start;
+      primes_counted = primes_count_primes_up_to(n_start - 1, &factors, sieve_size);
+    }
+    if (p->index_file != NULL) {
+      close_pi_index(&index);
+    }
+  }
+
+  if (p->threads_count > 1) {
+    calc_remaining_primes_parallel(from, n, sqrt_n, &factors, sieve_size, p->threads_count);
+  } else {
+    calc_remaining_primes(from, n, &factors, sieve, sieve_size);
+  }
+  enter_phase(PHASE_OTHER);
+  if (from / 30 <= n / 30) {
+    count_sieve_work(from / 30, (n / 30 - from / 30) / sieve_size + 1, &factors, sieve_size);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Setzt die Ausgabe der Primzahlen <= n beim Stand des Checkpoints fort (siehe
+  open_checkpoint). Nur die Primfaktoren bis sqrt(n) werden neu berechnet.
+------------------------------------------------------------------------------*/
+void resume_primes(const Parameters* p) {
+  uint64 from = progress.next_byte * 30;
+  uint32 sqrts[5];
+  uint32 sqrts_top = primes_calc_square_roots(p->n, sqrts);
 
-  uint32* primes = build_primes(prime_factors_count_estimated);
-  char* sieve = build_sieve(sqrt_n);
+  enter_phase(PHASE_BASE);
+  primes_init_wheel();
+  PrimeFactors factors;
+  primes_build_prime_factors(&factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+  uint32 sieve_size = primes_calc_sieve_size(p->n, p->sieve_size);
+  uint8* sieve = primes_build_sieve(sieve_size);
+  get_prime_factors(p->base_file, sqrts_top, sqrts, &factors, sieve, sieve_size);
 
-  uint32 primes_top = calc_prime_factors(sqrts_top, sqrts, primes, sieve);
-  calc_remaining_primes(n, sqrt_n, primes_top, primes, sieve); 
+  if (p->threads_count > 1) {
+    calc_remaining_primes_parallel(from, p->n, sqrts[0], &factors, sieve_size, p->threads_count);
+  } else {
+    calc_remaining_primes(from, p->n, &factors, sieve, sieve_size);
+  }
+  enter_phase(PHASE_OTHER);
+  count_sieve_work(from / 30, (p->n / 30 - from / 30) / sieve_size + 1, &factors, sieve_size);
+  free(sieve);
+  primes_free_prime_factors(&factors);
 }
 
 /*------------------------------------------------------------------------------
@@ -110,165 +860,1799 @@ void print_primes(uint64 n) {
   Zahlen die kleiner als n_start sind, werden nicht ausgegeben.
 ------------------------------------------------------------------------------*/
 void print_prime(uint64 prime_number) {
-  static uint64 primes_count = 0;
-  primes_count += 1;
+  primes_counted += 1;
   if (prime_number >= n_start) {
-    printf("%llu. prime = %llu\n", primes_count, prime_number);
+    write_prime(primes_counted, prime_number);
   }
 }
 
 /*------------------------------------------------------------------------------
-  Berechnet alle ungeraden Quadratwurzeln von n, solange bis der Wert 3 erreicht.
-  Statt 1 (== sqrt(3..8)) wird 3 verwendet. 
-  Zurckgegeben wird der Index der kleinsten (= Anzahl - 1).
+  Gibt die k-te Primzahl mit ihrer Nummer aus.
+------------------------------------------------------------------------------*/
+void print_nth_prime(const Parameters* p) {
+  uint64 limit = primes_nth_prime_limit(p->nth);
+  uint32 sqrts[5];
+  uint32 sqrts_top = primes_calc_square_roots(limit, sqrts);
+
+  enter_phase(PHASE_BASE);
+  primes_init_wheel();
+  PrimeFactors factors;
+  primes_build_prime_factors(&factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+  uint32 sieve_size = primes_calc_sieve_size(limit, p->sieve_size);
+  uint8* sieve = primes_build_sieve(sieve_size);
+  get_prime_factors(p->base_file, sqrts_top, sqrts, &factors, sieve, sieve_size);
+
+  enter_phase(PHASE_PI);
+  uint64 prime = primes_find_nth_prime(p->nth, &factors, sieve, sieve_size);
+  enter_phase(PHASE_OTHER);
+  write_prime(p->nth, prime);
+  free(sieve);
+  primes_free_prime_factors(&factors);
+}
+
+/*------------------------------------------------------------------------------
+  Gibt die Primzahlen zwischen from (> 5) und n ohne Sieb aus: die zu 30
+  teilerfremden Zahlen werden blockweise mit primes_is_prime_batch geprüft.
 ------------------------------------------------------------------------------*/
-uint32 calc_square_roots(uint64 n, uint32* sqrts) {
-  uint32 top = -1;
-  do {
-    sqrts[++top] = n = odd(integer_square_root(n));
-  } while (n > 3);
-  if (sqrts[top] == 1) {
-    sqrts[top] = 3;
+void test_primes(uint64 from, uint64 n) {
+  uint64 numbers[IS_PRIME_BATCH_SIZE];
+  uint8 results[IS_PRIME_BATCH_SIZE];
+  uint64 base = from / 30;
+  uint32 count;
+
+  while ((count = next_candidates(&base, from, n, numbers)) > 0) {
+    primes_is_prime_batch(numbers, count, results);
+    for (uint32 i = 0; i < count; i++) {
+      if (results[i]) {
+        print_prime(numbers[i]);
+      }
+    }
   }
-  return top;
 }
 
 /*------------------------------------------------------------------------------
-  Baut ein Array fr die Primfaktoren auf, das ausreichend gro ist.
+  Notiert die zu 30 teilerfremden Zahlen zwischen from und n ab base * 30 in
+  numbers (höchstens IS_PRIME_BATCH_SIZE) und rückt base entsprechend vor.
+  Zurückgegeben wird deren Anzahl, 0 am Ende des Bereichs.
 ------------------------------------------------------------------------------*/
-uint32* build_primes(uint32 prime_factors_count_estimated) {
-  uint32* primes;
-  size_t primes_size = sizeof(primes[0]) * prime_factors_count_estimated;
-  if ((primes = malloc(primes_size)) == NULL) {
-    perror("memory error");
-    exit(2);
+uint32 next_candidates(uint64* base, uint64 from, uint64 n, uint64* numbers) {
+  static const uint32 offsets[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+  uint32 count = 0;
+
+  for (; *base <= n / 30 && count <= IS_PRIME_BATCH_SIZE - 8; *base += 1) {
+    /* base * 30 + offset kann über 2^64 - 1 hinausgehen, n - base * 30 nicht */
+    for (uint32 i = 0; i < 8 && offsets[i] <= n - *base * 30; i++) {
+      if (*base * 30 + offsets[i] >= from) {
+        numbers[count++] = *base * 30 + offsets[i];
+      }
+    }
   }
-  return primes;
+  return count;
 }
 
 /*------------------------------------------------------------------------------
-  Baut ein Sieb auf, das ausreichend gro und mit Nullen initialisiert ist.
+  Prüft die Zahlen von stdin blockweise und schreibt je Zahl eine Zeile.
 
-  Speicher wird in einer Grenordnung der Wurzel von n bentigt.
+  Für ein Wort, das keine Zahl < 2^64 ist, steht an seiner Stelle eine
+  Fehlerzeile; der Block bis dorthin wird vorher ausgegeben, danach geht es
+  weiter. Zurückgegeben wird die Anzahl dieser Wörter.
 ------------------------------------------------------------------------------*/
-char* build_sieve(uint32 sqrt_n) {
-  char* sieve;
-  size_t sieve_size = sizeof(sieve[0]) * sqrt_n;  
-  if ((sieve = malloc(sieve_size)) == NULL) {
-    perror("memory error");
-    exit(3);
+uint64 check_primes(void) {
+  uint64 numbers[IS_PRIME_BATCH_SIZE];
+  uint8 results[IS_PRIME_BATCH_SIZE];
+  char token[32];
+  uint64 errors = 0;
+  int end = 0;
+
+  while (!end) {
+    uint32 count = 0;
+    int invalid = 0;
+    while (count < IS_PRIME_BATCH_SIZE && !invalid && !(end = (scanf("%31s", token) != 1))) {
+      /* ein längeres Wort ist keine Zahl < 2^64; sein Rest wird übergangen */
+      int c = getchar();
+      if (c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        while ((c = getchar()) != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        }
+        invalid = 1;
+      } else if (!parse_number(token, &numbers[count])) {
+        invalid = 1;
+      } else {
+        count += 1;
+      }
+    }
+    primes_is_prime_batch(numbers, count, results);
+    for (uint32 i = 0; i < count; i++) {
+      char* pos = format_number(output.pos, numbers[i]);
+      memcpy(pos, results[i] ? " is prime\n" : " is not prime\n", results[i] ? 10 : 14);
+      output.pos = pos + (results[i] ? 10 : 14);
+      if (output.pos >= output.end) {
+        flush_output();
+      }
+    }
+    if (invalid) {
+      char* pos = output.pos;
+      memcpy(pos, "error: invalid number ", 22);
+      memcpy(pos + 22, token, strlen(token));
+      pos += 22 + strlen(token);
+      *pos++ = '\n';
+      output.pos = pos;
+      if (output.pos >= output.end) {
+        flush_output();
+      }
+      errors += 1;
+    }
   }
-  memset(sieve, 0, sieve_size);
-  return sieve;
+  flush_output();
+  return errors;
 }
 
 /*------------------------------------------------------------------------------
-  Berechnet alle ungeraden Primzahlen <= sqrt(n).
-  Die Primzahlen werden auch ausgegeben.
-  Zurckgegeben wird der Index der grten Primzahl (= Anzahl - 2).
+  Bereitet die Ausgabe vor.
+
+  Ausgegeben wird über große, an Seiten ausgerichtete Puffer mit möglichst
+  wenigen Systemaufrufen. Mit zero_copy wird, wenn stdout eine Pipe ist, per
+  vmsplice geschrieben: die Seiten des Puffers gehen dabei direkt in die Pipe
+  über. Ein Puffer darf deshalb erst wieder beschrieben werden, wenn die Pipe
+  ihn sicher weitergegeben hat; das ist der Fall, wenn danach mehr als die
+  Kapazität der Pipe geschrieben wurde. Es wird deshalb reihum in mehrere Puffer
+  geschrieben und die Pipe auf die Größe eines Puffers begrenzt.
 ------------------------------------------------------------------------------*/
-uint32 calc_prime_factors(uint32 sqrts_top, uint32* sqrts, uint32* primes, char* sieve) {
-  uint32 primes_top = 0;
-  primes[0] = 3;
-  print_prime(3);
+void init_output(const Parameters* p) {
+  output.plain = p->plain;
+  output.binary = p->binary && !p->count_only;
+  output.count_only = p->count_only || p->index_build;
+  output.zero_copy = 0;
+#ifdef _WIN32
+  if (output.binary) {
+    _setmode(_fileno(stdout), _O_BINARY);
+  }
+#endif
+#ifdef __linux__
+  struct stat st;
+  if (   p->zero_copy && fstat(1, &st) == 0 && S_ISFIFO(st.st_mode)
+      && fcntl(1, F_SETPIPE_SZ, OUTPUT_BUFFER_SIZE) > 0
+      && fcntl(1, F_GETPIPE_SZ) <= OUTPUT_BUFFER_SIZE) {
+    output.zero_copy = 1;
+  }
+#endif
 
-  while (sqrts_top > 0) {
-    sqrts_top -= 1;
+  for (uint32 i = 0; i < OUTPUT_BUFFERS_COUNT; i++) {
+#ifdef _WIN32
+    output.buffers[i] = _aligned_malloc(OUTPUT_BUFFER_SIZE, 4096);
+#else
+    if (posix_memalign((void**) &output.buffers[i], 4096, OUTPUT_BUFFER_SIZE) != 0) {
+      output.buffers[i] = NULL;
+    }
+#endif
+    if (output.buffers[i] == NULL) {
+      perror("memory error");
+      exit(2);
+    }
+  }
+  output.buffer = 0;
+  output.pos = output.buffers[0];
+  output.end = output.buffers[0] + OUTPUT_BUFFER_SIZE - OUTPUT_LINE_SIZE;
+  output.written = 0;
+  output.count = 0;
+  output.last_prime = 0;
+  output.first_serial = 0;
+  output.first_prime = 0;
+  output.last_serial = 0;
+  output.index = NULL;
+  output.index_count = 0;
+  output.index_capacity = 0;
+  output.pipelined = 0;
+  set_serial(0);
+}
 
-    /* Nicht-Primzahlen markieren */
-    for (uint32 i = 0; i <= primes_top; i++) {
-      for (uint32 j = (sqrts[sqrts_top + 1] - 3) / 2 + primes[i]
-                    - (sqrts[sqrts_top + 1] - primes[i]) / 2 % primes[i];
-           j <= (sqrts[sqrts_top] - 3) / 2;
-           j += primes[i]) {
-        sieve[j] = 1;
+/*------------------------------------------------------------------------------
+  Schreibt eine Primzahl und deren Nummer in den Ausgabepuffer.
+
+  Die Nummer steht bereits als Ziffernfolge bereit. Folgt sie direkt auf die
+  zuletzt ausgegebene, dann wird diese Ziffernfolge nur um 1 erhöht.
+------------------------------------------------------------------------------*/
+void write_prime(uint64 serial, uint64 prime_number) {
+  char* pos = output.pos;
+
+  if (output.binary) {
+    write_prime_binary(serial, prime_number);
+    return;
+  }
+  if (output.count_only) {
+    count_prime(serial, prime_number);
+    return;
+  }
+  if (!output.plain) {
+    if (serial == output.serial + 1) {
+      char* digit = output.serial_digits + 20;
+      while (*--digit == '9') {
+        *digit = '0';
       }
+      *digit += 1;
+      if (digit < output.serial_first) {
+        output.serial_first = digit;
+      }
+      output.serial = serial;
+    } else {
+      set_serial(serial);
     }
+    size_t length = output.serial_digits + 20 - output.serial_first;
+    memcpy(pos, output.serial_first, length);
+    memcpy(pos + length, ". prime = ", 10);
+    pos += length + 10;
+  }
 
-    /* Primzahlen notieren und ausgeben */
-    for (uint32 j = (sqrts[sqrts_top + 1] - 1) / 2; j <= (sqrts[sqrts_top] - 3) / 2; j++) {
-      if (sieve[j] == 0) {
-        primes[++primes_top] = j * 2 + 3;
-        print_prime(primes[primes_top]);
-      } else {
-        sieve[j] = 0;
-      }
+  pos = format_number(pos, prime_number);
+  *pos++ = '\n';
+
+  output.pos = pos;
+  if (pos >= output.end) {
+    flush_output();
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt eine Primzahl im Binärformat in den Ausgabepuffer: die erste in den
+  Kopf, jede weitere als Abstand zur vorigen.
+------------------------------------------------------------------------------*/
+void write_prime_binary(uint64 serial, uint64 prime_number) {
+  char* pos = output.pos;
+
+  if (output.count == 0) {
+    memcpy(pos, "PRIMEGAP", 8);
+    pos = put_uint64(pos + 8, serial);
+    pos = put_uint64(pos, prime_number);
+    pos = put_uint64(pos, BINARY_INDEX_INTERVAL);
+  } else {
+    uint64 code = (prime_number - output.last_prime + 1) >> 1;
+    while (code >= 0x80) {
+      *pos++ = (char) (code | 0x80);
+      code >>= 7;
     }
+    *pos++ = (char) code;
+  }
+  if (output.count % BINARY_INDEX_INTERVAL == 0) {
+    add_index_entry(serial, prime_number, output.written + (pos - output.buffers[output.buffer]));
   }
+  output.count += 1;
+  output.last_prime = prime_number;
 
-  return primes_top;
+  output.pos = pos;
+  if (pos >= output.end) {
+    flush_output();
+  }
 }
 
 /*------------------------------------------------------------------------------
-  Berechnet alle ungeraden Primzahlen > sqrt(n) und <= n.
-  Die Primzahlen werden auch ausgegeben.
+  Zählt eine Primzahl, statt sie auszugeben.
+------------------------------------------------------------------------------*/
+void count_prime(uint64 serial, uint64 prime_number) {
+  if (output.count == 0) {
+    output.first_serial = serial;
+    output.first_prime = prime_number;
+  }
+  output.count += 1;
+  output.last_serial = serial;
+  output.last_prime = prime_number;
+}
+
+/*------------------------------------------------------------------------------
+  Merkt sich einen Eintrag für den Index des Binärformats.
 ------------------------------------------------------------------------------*/
-void calc_remaining_primes(uint64 n, uint32 sqrt_n, uint32 primes_top, uint32* primes, char* sieve) { 
-  for (uint64 z = 2ULL + sqrt_n; ; z += 2ULL * sqrt_n) {
+void add_index_entry(uint64 serial, uint64 prime_number, uint64 offset) {
+  if (output.index_count == output.index_capacity) {
+    output.index_capacity = output.index_capacity ? 2 * output.index_capacity : 1024;
+    output.index = realloc(output.index, output.index_capacity * sizeof(IndexEntry));
+    if (output.index == NULL) {
+      perror("memory error");
+      exit(2);
+    }
+  }
+  output.index[output.index_count].serial = serial;
+  output.index[output.index_count].prime = prime_number;
+  output.index[output.index_count].offset = offset;
+  output.index_count += 1;
+}
 
-    /* Nicht-Primzahlen markieren */
-    for (uint32 i = 0; i <= primes_top; i++) {
-      uint32 j = primes[i] - 1 - (z - 2 - primes[i]) % (primes[i] * 2) / 2;
-      while (1) {
-        sieve[j] = 1;
-        if (j >= sqrt_n - primes[i]) {
-          break;
-        }
-        j += primes[i];
-      }
+/*------------------------------------------------------------------------------
+  Schließt die Ausgabe ab; im Binärformat folgen den Daten Index und Ende.
+------------------------------------------------------------------------------*/
+void finish_output(void) {
+  if (output.count_only) {
+    printf("%" PRIu64 " primes\n", output.count);
+    if (output.count > 0) {
+      printf("first: %" PRIu64 ". prime = %" PRIu64 "\n", output.first_serial, output.first_prime);
+      printf("last: %" PRIu64 ". prime = %" PRIu64 "\n", output.last_serial, output.last_prime);
     }
-    
-    /* Primzahlen notieren und ausgeben */
-    for (uint32 j = 0; j < sqrt_n; j++) {
-      if (sieve[j] == 0) {
-        if (z > n - 2ULL * j) {
-          return;
-        }
-        print_prime(z + 2ULL * j);
-      } else {
-        sieve[j] = 0;
+    if (fflush(stdout) != 0) {
+      perror("output error");
+      exit(5);
+    }
+  }
+  if (output.binary) {
+    if (output.count == 0) {
+      memcpy(output.pos, "PRIMEGAP", 8);
+      output.pos = put_uint64(output.pos + 8, 0);
+      output.pos = put_uint64(output.pos, 0);
+      output.pos = put_uint64(output.pos, BINARY_INDEX_INTERVAL);
+    }
+    *output.pos++ = 0;
+
+    uint64 index_offset = output.written + (output.pos - output.buffers[output.buffer]);
+    for (uint32 i = 0; i < output.index_count; i++) {
+      output.pos = put_uint64(output.pos, output.index[i].serial);
+      output.pos = put_uint64(output.pos, output.index[i].prime);
+      output.pos = put_uint64(output.pos, output.index[i].offset);
+      if (output.pos >= output.end) {
+        flush_output();
       }
     }
+    output.pos = put_uint64(output.pos, output.count);
+    output.pos = put_uint64(output.pos, output.last_prime);
+    output.pos = put_uint64(output.pos, index_offset);
+    output.pos = put_uint64(output.pos, output.index_count);
+    memcpy(output.pos, "PRIMEEND", 8);
+    output.pos += 8;
+    free(output.index);
   }
+  flush_output();
 }
 
-/*==============================================================================
-  allgemeine Funktionen
-==============================================================================*/
+/*------------------------------------------------------------------------------
+  Schreibt x als 8 Bytes little-endian ab pos.
+------------------------------------------------------------------------------*/
+char* put_uint64(char* pos, uint64 x) {
+  for (int i = 0; i < 8; i++) {
+    *pos++ = (char) (x >> 8 * i);
+  }
+  return pos;
+}
 
 /*------------------------------------------------------------------------------
-  convert a string to an unsigned long integer
+  Stellt die Ziffernfolge der Nummer neu auf.
 ------------------------------------------------------------------------------*/
-uint64 atoul(const char* str) {
-  uint64 ull = 0;
+void set_serial(uint64 serial) {
+  char digits[20];
+  char* end = format_number(digits, serial);
+  size_t length = end - digits;
 
-  while (*str != 0) {
-    if ((*str < '0' || *str > '9')
-      || ull > 1844674407370955161ULL
-      || (ull *= 10) > 18446744073709551615ULL - (*str - '0')) {
-      return 0;
-    }
-    ull += (*str++ - '0');
+  memset(output.serial_digits, '0', 20);
+  output.serial_digits[20] = 0;
+  output.serial_first = output.serial_digits + 20 - length;
+  memcpy(output.serial_first, digits, length);
+  output.serial = serial;
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt x als Dezimalzahl ab pos, je zwei Ziffern auf einmal.
+  Zurückgegeben wird die Position hinter der letzten Ziffer.
+------------------------------------------------------------------------------*/
+char* format_number(char* pos, uint64 x) {
+  uint32 length = 1;
+  for (uint64 y = x; y >= 10; y /= 10) {
+    length += 1;
   }
-  return ull;
+
+  char* end = pos + length;
+  while (x >= 100) {
+    uint32 pair = (uint32) (x % 100);
+    x /= 100;
+    pos[--length] = digit_pairs[2 * pair + 1];
+    pos[--length] = digit_pairs[2 * pair];
+  }
+  if (x >= 10) {
+    pos[1] = digit_pairs[2 * x + 1];
+    pos[0] = digit_pairs[2 * x];
+  } else {
+    pos[0] = (char) ('0' + x);
+  }
+  return end;
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt den aktuellen Ausgabepuffer und wechselt ggf. zum nächsten.
+------------------------------------------------------------------------------*/
+void flush_output(void) {
+  char* buffer = output.buffers[output.buffer];
+  uint32 phase = enter_phase(PHASE_OUTPUT);
+
+  if (output.pipelined) {
+    output.sizes[output.buffer] = (uint32) (output.pos - buffer);
+    output.written += output.pos - buffer;
+    store_release(&output.flushed.head, output.flushed.head + 1);
+    wait_for_space(&output.flushed, OUTPUT_BUFFERS_COUNT);
+    output.buffer = output.flushed.head % OUTPUT_BUFFERS_COUNT;
+    output.pos = output.buffers[output.buffer];
+    output.end = output.pos + OUTPUT_BUFFER_SIZE - OUTPUT_LINE_SIZE;
+    enter_phase(phase);
+    return;
+  }
+
+  write_buffer(buffer, output.pos - buffer);
+  output.written += output.pos - buffer;
+  if (output.zero_copy) {
+    output.buffer = (output.buffer + 1) % OUTPUT_BUFFERS_COUNT;
+    buffer = output.buffers[output.buffer];
+  }
+  output.pos = buffer;
+  output.end = buffer + OUTPUT_BUFFER_SIZE - OUTPUT_LINE_SIZE;
+  enter_phase(phase);
 }
 
 /*------------------------------------------------------------------------------
-  Berechnet ISQRT = die ganzzahlige 32-Bit Qudratwurzel einer 64-Bit-Zahl.
-  Es gilt: ISQRT^2 <= x.
+  Schreibt einen Puffer vollständig nach stdout.
 ------------------------------------------------------------------------------*/
-uint32 integer_square_root(uint64 x) {
-  uint32 y = (uint32) sqrt((double) x);
-  return ((uint64) y * (uint64) y <= x) ? y : (y - 1);
+void write_buffer(char* buffer, size_t size) {
+#ifdef _WIN32
+  if (fwrite(buffer, 1, size, stdout) != size || fflush(stdout) != 0) {
+    perror("output error");
+    exit(5);
+  }
+#else
+  while (size > 0) {
+    ssize_t written;
+#ifdef __linux__
+    if (output.zero_copy) {
+      struct iovec iov;
+      iov.iov_base = buffer;
+      iov.iov_len = size;
+      written = vmsplice(1, &iov, 1, 0);
+    } else
+#endif
+    written = write(1, buffer, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      perror("output error");
+      exit(5);
+    }
+    buffer += written;
+    size -= (size_t) written;
+  }
+#endif
 }
 
 /*------------------------------------------------------------------------------
-  Berechnet eine Abschtzung EPRIM fr die Anzahl der Primzahlen <= x.
-  Es gilt: EPRIM >= pi(x)
+  Berechnet alle Primzahlen >= from (> sqrt(n)) und <= n.
+  Die Primzahlen werden auch ausgegeben.
 ------------------------------------------------------------------------------*/
-uint32 estimate_number_of_primes_up_to(uint32 x) {
-  return (uint32) (158 + (double) x
-                         / (log(x) - 1.052400915 - (log(4294967295U) - log(x))
-                                                 * 0.08149));
-//return (uint32) (158 + (double) x / (log(x) * 1.08149 - 2.859906955));
+void calc_remaining_primes(uint64 from, uint64 n, const PrimeFactors* factors, uint8* sieve, uint32 sieve_size) {
+  SegmentedSieve s;
+
+  primes_init_segmented_sieve(&s, factors, factors->count, sieve_size, n);
+
+  /* mit --stats bleibt es beim Ablauf ohne Pipeline, damit sich die Phasen
+     messen lassen; auf einem Prozessor brächte sie nichts */
+  if (!output.count_only && !stats.enabled && count_processors() > 1) {
+    calc_remaining_primes_pipelined(from, n, &s, sieve_size);
+    primes_free_segmented_sieve(&s);
+    return;
+  }
+
+  for (uint64 low_byte = from / 30; low_byte <= n / 30; low_byte += sieve_size) {
+
+    /* Nicht-Primzahlen markieren */
+    enter_phase(PHASE_SIEVE);
+    primes_sieve_next_segment(&s, sieve, low_byte);
+
+    /* Primzahlen notieren und ausgeben bzw. zählen */
+    enter_phase(PHASE_SCAN);
+    primes_limit_segment(sieve, low_byte, sieve_size, from, n);
+    if (output.count_only) {
+      count_segment_output(sieve, low_byte, sieve_size, primes_count_segment_primes(sieve, sieve_size));
+    } else {
+      print_segment_primes(sieve, low_byte, sieve_size);
+    }
+    save_checkpoint(low_byte + sieve_size);
+  }
+
+  primes_free_segmented_sieve(&s);
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet und schreibt die Primzahlen >= from und <= n in drei Stufen mit je
+  einem Thread: sieve_segments siebt in einen Ring von Segmenten, der
+  aufrufende Thread formatiert deren Primzahlen in die Ausgabepuffer, und
+  write_buffers schreibt die vollen Puffer. Die Stufen sind über Queues ohne
+  Sperren verbunden; der Durchsatz richtet sich so nach der langsamsten Stufe
+  statt nach der Summe aller.
+------------------------------------------------------------------------------*/
+void calc_remaining_primes_pipelined(uint64 from, uint64 n, SegmentedSieve* s, uint32 sieve_size) {
+  Pipeline pipeline;
+  Thread sieving, writing;
+
+  pipeline.s = s;
+  pipeline.from = from;
+  pipeline.n = n;
+  pipeline.sieve_size = sieve_size;
+  pipeline.sieved.head = pipeline.sieved.tail = 0;
+  for (uint32 i = 0; i < PIPELINE_SEGMENTS; i++) {
+    pipeline.segments[i] = primes_build_sieve(sieve_size);
+  }
+
+  /* der aktuelle Puffer ist der nächste Eintrag der Queue */
+  output.flushed.head = output.flushed.tail = output.buffer;
+  output.pipelined = 1;
+  start_thread(&sieving, sieve_segments, &pipeline);
+  start_thread(&writing, write_buffers, NULL);
+
+  uint32 entry = 0;
+  for (uint64 low_byte = from / 30; low_byte <= n / 30; low_byte += sieve_size) {
+    wait_for_entry(&pipeline.sieved, entry);
+    print_segment_primes(pipeline.segments[entry % PIPELINE_SEGMENTS], low_byte, sieve_size);
+    store_release(&pipeline.sieved.tail, ++entry);
+    save_checkpoint(low_byte + sieve_size);
+  }
+
+  /* Ende an den Writer melden; der noch nicht volle Puffer bleibt für
+     finish_output */
+  output.sizes[output.flushed.head % OUTPUT_BUFFERS_COUNT] = 0;
+  store_release(&output.flushed.head, output.flushed.head + 1);
+  join_thread(sieving);
+  join_thread(writing);
+  output.pipelined = 0;
+
+  for (uint32 i = 0; i < PIPELINE_SEGMENTS; i++) {
+    free(pipeline.segments[i]);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Sieb-Stufe der Pipeline: siebt die Segmente der Reihe nach in den Ring.
+------------------------------------------------------------------------------*/
+THREAD_FUNCTION sieve_segments(void* arg) {
+  Pipeline* pipeline = arg;
+  uint32 entry = 0;
+
+  for (uint64 low_byte = pipeline->from / 30; low_byte <= pipeline->n / 30; low_byte += pipeline->sieve_size) {
+    uint8* sieve = pipeline->segments[entry % PIPELINE_SEGMENTS];
+    wait_for_space(&pipeline->sieved, PIPELINE_SEGMENTS);
+    primes_sieve_next_segment(pipeline->s, sieve, low_byte);
+    primes_limit_segment(sieve, low_byte, pipeline->sieve_size, pipeline->from, pipeline->n);
+    store_release(&pipeline->sieved.head, ++entry);
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+  Schreib-Stufe der Pipeline: schreibt die vollen Puffer der Reihe nach.
+
+  Per vmsplice übergebene Seiten dürfen erst wieder beschrieben werden, wenn
+  die Pipe sie weitergegeben hat, also nachdem ein weiterer Puffer geschrieben
+  wurde (siehe init_output); mit zero_copy wird ein Puffer deshalb erst nach
+  dem nächsten freigegeben.
+------------------------------------------------------------------------------*/
+THREAD_FUNCTION write_buffers(void* arg) {
+  uint32 entry = output.flushed.tail;
+  uint32 lag = (output.zero_copy) ? 1 : 0;
+
+  (void) arg;
+  for (;;) {
+    wait_for_entry(&output.flushed, entry);
+    uint32 buffer = entry % OUTPUT_BUFFERS_COUNT;
+    if (output.sizes[buffer] == 0) {
+      break;
+    }
+    write_buffer(output.buffers[buffer], output.sizes[buffer]);
+    entry += 1;
+    store_release(&output.flushed.tail, entry - lag);
+  }
+  store_release(&output.flushed.tail, entry + 1);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+  Wartet, bis eine Queue den Eintrag entry enthält (Verbraucher) bzw. bis sie
+  weniger als capacity Einträge enthält (Erzeuger).
+------------------------------------------------------------------------------*/
+void wait_for_entry(Queue* queue, uint32 entry) {
+  uint32 spins = 0;
+
+  while (load_acquire(&queue->head) == entry) {
+    wait_a_moment(&spins);
+  }
+}
+
+void wait_for_space(Queue* queue, uint32 capacity) {
+  uint32 spins = 0;
+
+  while (queue->head - load_acquire(&queue->tail) >= capacity) {
+    wait_a_moment(&spins);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Wartet kurz aktiv und gibt danach den Prozessor ab.
+------------------------------------------------------------------------------*/
+void wait_a_moment(uint32* spins) {
+  if (++*spins > 256) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet alle Primzahlen >= from (> sqrt(n)) und <= n mit mehreren Threads.
+  Die Primzahlen werden auch ausgegeben.
+
+  Der Bereich wird in Abschnitte (Chunks) aus mehreren Segmenten aufgeteilt, die
+  jeweils 2 * sqrt(n) Zahlen umfassen, aber höchstens CHUNK_SEGMENTS_MAX
+  Segmente; der Speicher je Thread hängt so nicht von n ab. Jeder Thread siebt
+  einen Abschnitt mit eigenen Vielfachen und Buckets und zählt dessen
+  Primzahlen. Die Summe der
+  Anzahlen aller vorherigen Abschnitte ist dann die Nummer der ersten Primzahl
+  eines Abschnitts; Abschnitte unterhalb von n_start werden so nur gezählt.
+
+  Ausgegeben wird der Reihe nach, und zwar während die Threads bereits die
+  nächsten Abschnitte sieben. Deshalb gibt es zwei Sätze von Abschnitten.
+------------------------------------------------------------------------------*/
+void calc_remaining_primes_parallel(uint64 from, uint64 n, uint32 sqrt_n, const PrimeFactors* factors, uint32 sieve_size, uint32 threads_count) {
+  uint64 chunk_size = ((2ULL * sqrt_n) / 30 + sieve_size) & ~(sieve_size - 1ULL);
+  if (chunk_size > (uint64) CHUNK_SEGMENTS_MAX * sieve_size) {
+    chunk_size = (uint64) CHUNK_SEGMENTS_MAX * sieve_size;
+  }
+  Chunk* chunks = build_chunks(2 * threads_count, (uint32) chunk_size);
+  Thread* threads = malloc(threads_count * sizeof(Thread));
+  uint64 low_byte = from / 30;
+  uint32 started[2];
+
+  if (threads == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  for (uint32 i = 0; i < 2 * threads_count; i++) {
+    chunks[i].factors = factors;
+    chunks[i].sieve_size = sieve_size;
+    chunks[i].from = from;
+    chunks[i].to = n;
+  }
+
+  enter_phase(PHASE_SIEVE);
+  started[0] = start_chunks(chunks, threads, threads_count, &low_byte, n / 30, (uint32) chunk_size);
+  for (uint32 t = 0; t < started[0]; t++) {
+    join_thread(threads[t]);
+  }
+
+  for (uint32 round = 0; started[round & 1] > 0; round++) {
+    Chunk* sieved = chunks + (round & 1) * threads_count;
+    Chunk* next = chunks + (~round & 1) * threads_count;
+
+    /* nächste Abschnitte sieben lassen */
+    started[~round & 1] = start_chunks(next, threads, threads_count, &low_byte, n / 30, (uint32) chunk_size);
+
+    /* Primzahlen der gesiebten Abschnitte der Reihe nach ausgeben */
+    enter_phase(PHASE_SCAN);
+    for (uint32 t = 0; t < started[round & 1]; t++) {
+      Chunk* chunk = &sieved[t];
+      if ((chunk->low_byte + chunk->size) * 30 <= n_start) {
+        primes_counted += chunk->count;
+      } else if (output.count_only) {
+        count_segment_output(chunk->sieve, chunk->low_byte, chunk->size, chunk->count);
+      } else {
+        print_segment_primes(chunk->sieve, chunk->low_byte, chunk->size);
+      }
+      save_checkpoint(chunk->low_byte + chunk->size);
+    }
+
+    enter_phase(PHASE_SIEVE);
+    for (uint32 t = 0; t < started[~round & 1]; t++) {
+      join_thread(threads[t]);
+    }
+  }
+
+  for (uint32 i = 0; i < 2 * threads_count; i++) {
+    free(chunks[i].sieve);
+  }
+  free(chunks);
+  free(threads);
+}
+
+/*------------------------------------------------------------------------------
+  Startet für die nächsten (höchstens threads_count) Abschnitte ab low_byte bis
+  einschließlich last_byte je einen Thread.
+  Zurückgegeben wird die Anzahl der gestarteten Threads.
+------------------------------------------------------------------------------*/
+uint32 start_chunks(Chunk* chunks, Thread* threads, uint32 threads_count, uint64* low_byte, uint64 last_byte, uint32 chunk_size) {
+  uint32 started = 0;
+
+  while (started < threads_count && *low_byte <= last_byte) {
+    Chunk* chunk = &chunks[started];
+    chunk->low_byte = *low_byte;
+    chunk->size = (last_byte - *low_byte < chunk_size)
+                ? (uint32) ((last_byte - *low_byte + chunk->sieve_size) & ~(chunk->sieve_size - 1ULL))
+                : chunk_size;
+    start_thread(&threads[started++], sieve_chunk, chunk);
+    *low_byte += chunk->size;
+  }
+  return started;
+}
+
+/*------------------------------------------------------------------------------
+  Baut die Abschnitte für die Threads auf.
+------------------------------------------------------------------------------*/
+Chunk* build_chunks(uint32 chunks_count, uint32 chunk_size) {
+  Chunk* chunks;
+  if ((chunks = calloc(chunks_count, sizeof(Chunk))) == NULL) {
+    perror("memory error");
+    exit(2);
+  }
+  for (uint32 i = 0; i < chunks_count; i++) {
+    chunks[i].sieve = primes_build_sieve(chunk_size);
+  }
+  return chunks;
+}
+
+/*------------------------------------------------------------------------------
+  Siebt einen Abschnitt Segment für Segment und zählt seine Primzahlen.
+  Die Vielfachen der Primfaktoren werden dafür neu berechnet; in die Buckets
+  kommen nur die, die den Abschnitt noch treffen.
+------------------------------------------------------------------------------*/
+THREAD_FUNCTION sieve_chunk(void* arg) {
+  Chunk* chunk = arg;
+  SegmentedSieve s;
+  uint64 last_byte = chunk->low_byte + chunk->size - 1;
+  uint64 to = (last_byte < chunk->to / 30) ? last_byte * 30 + 29 : chunk->to;
+
+  primes_init_segmented_sieve(&s, chunk->factors, chunk->factors->count, chunk->sieve_size, to);
+  chunk->count = 0;
+
+  for (uint32 pos = 0; pos < chunk->size; pos += chunk->sieve_size) {
+    uint8* sieve = chunk->sieve + pos;
+    primes_sieve_next_segment(&s, sieve, chunk->low_byte + pos);
+    primes_limit_segment(sieve, chunk->low_byte + pos, chunk->sieve_size, chunk->from, chunk->to);
+    chunk->count += primes_count_segment_primes(sieve, chunk->sieve_size);
+  }
+
+  primes_free_segmented_sieve(&s);
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+  Startet einen Thread (z.B. sieve_chunk für einen Abschnitt) bzw. wartet auf
+  sein Ende.
+------------------------------------------------------------------------------*/
+void start_thread(Thread* thread, ThreadFunction function, void* arg) {
+#ifdef _WIN32
+  if ((*thread = CreateThread(NULL, 0, function, arg, 0, NULL)) == NULL) {
+#else
+  if (pthread_create(thread, NULL, function, arg) != 0) {
+#endif
+    perror("thread error");
+    exit(4);
+  }
+}
+
+void join_thread(Thread thread) {
+#ifdef _WIN32
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+#else
+  pthread_join(thread, NULL);
+#endif
+}
+
+/*------------------------------------------------------------------------------
+  Gibt alle Primzahlen im Segment aus.
+
+  Das Sieb wird in 64-Bit-Worten (little endian) ausgewertet, d.h. 8 Bytes bzw.
+  240 Zahlen auf einmal.
+------------------------------------------------------------------------------*/
+void print_segment_primes(uint8* sieve, uint64 low_byte, uint32 size) {
+  for (uint32 j = 0; j < size; j += 8) {
+    uint64 word;
+    memcpy(&word, sieve + j, sizeof(word));
+    while (word != 0) {
+      print_prime((low_byte + j) * 30 + primes_wheel_offsets[ctz64(word)]);
+      word &= word - 1;
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Zählt die Primzahlen eines Segments (count = deren Anzahl) statt sie
+  auszugeben. Nur die ab n_start zählen als ausgegeben; von diesen werden die
+  erste und die letzte bestimmt.
+------------------------------------------------------------------------------*/
+void count_segment_output(uint8* sieve, uint64 low_byte, uint32 size, uint64 count) {
+  if (low_byte * 30 < n_start) {
+    primes_limit_segment(sieve, low_byte, size, n_start, 18446744073709551615ULL);
+    uint64 count_below = count;
+    count = primes_count_segment_primes(sieve, size);
+    primes_counted += count_below - count;
+  }
+  if (count == 0) {
+    return;
+  }
+  if (output.count == 0) {
+    output.first_serial = primes_counted + 1;
+    output.first_prime = primes_first_segment_prime(sieve, low_byte, size);
+  }
+  primes_counted += count;
+  output.count += count;
+  output.last_serial = primes_counted;
+  output.last_prime = primes_last_segment_prime(sieve, low_byte, size);
+}
+
+/*==============================================================================
+  Checkpoints (--checkpoint, --resume)
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Bereitet die Checkpoints vor; mit --resume wird der Stand des letzten
+  Checkpoints übernommen und die Ausgabe auf dessen Länge gekürzt, sodass sie
+  genau dort weitergeht. Ohne Checkpoint wird sie geleert.
+------------------------------------------------------------------------------*/
+void open_checkpoint(const Parameters* p) {
+  progress.file = p->checkpoint_file;
+  progress.n_start = p->n_start;
+  progress.n = p->n;
+  progress.format = output.count_only ? 3 : output.binary ? 2 : output.plain ? 1 : 0;
+  progress.next_byte = 0;
+  progress.due = wall_clock() + CHECKPOINT_INTERVAL;
+  if (p->resume) {
+    read_checkpoint(p->checkpoint_file);
+  }
+  if (output.count_only) {
+    return;
+  }
+
+#ifdef _WIN32
+  int fd = _fileno(stdout);
+  struct _stat64 st;
+  if (_fstat64(fd, &st) != 0 || (st.st_mode & _S_IFMT) != _S_IFREG) {
+#else
+  struct stat st;
+  if (fstat(1, &st) != 0 || !S_ISREG(st.st_mode)) {
+#endif
+    fprintf(stderr, "%s: the output must be a regular file\n", p->checkpoint_file);
+    exit(10);
+  }
+  if (!p->resume) {
+    return;
+  }
+  if ((uint64) st.st_size < output.written) {
+    fprintf(stderr, "%s: the output is shorter than at the checkpoint\n", p->checkpoint_file);
+    exit(10);
+  }
+#ifdef _WIN32
+  if (_chsize_s(fd, output.written) != 0 || _fseeki64(stdout, output.written, SEEK_SET) != 0) {
+#else
+  if (ftruncate(1, (off_t) output.written) != 0 || lseek(1, (off_t) output.written, SEEK_SET) < 0) {
+#endif
+    perror("output error");
+    exit(5);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Übernimmt primes_counted und den Stand der Ausgabe aus dem Checkpoint; fehlt
+  die Datei, dann bleibt es beim Anfang.
+------------------------------------------------------------------------------*/
+void read_checkpoint(const char* file_name) {
+  char header[CHECKPOINT_HEADER_SIZE];
+  uint64 values[12];
+  FILE* file = fopen(file_name, "rb");
+
+  if (file == NULL && errno == ENOENT) {
+    return;
+  }
+  if (file == NULL) {
+    checkpoint_error(file_name);
+  }
+  if (   fread(header, 1, CHECKPOINT_HEADER_SIZE, file) != CHECKPOINT_HEADER_SIZE
+      || memcmp(header, "PRIMECKP", 8) != 0) {
+    fprintf(stderr, "%s: not a primes checkpoint\n", file_name);
+    exit(10);
+  }
+  memcpy(values, header + 8, sizeof(values));
+  if (values[0] != progress.n_start || values[1] != progress.n || values[2] != progress.format) {
+    fprintf(stderr, "%s: checkpoint of another range or format\n", file_name);
+    exit(10);
+  }
+  progress.next_byte = values[3];
+  primes_counted = values[4];
+  output.written = values[5];
+  output.count = values[6];
+  output.last_prime = values[7];
+  output.first_serial = values[8];
+  output.first_prime = values[9];
+  output.last_serial = values[10];
+  for (uint64 i = 0; i < values[11]; i++) {
+    uint64 entry[3];
+    if (fread(entry, 1, sizeof(entry), file) != sizeof(entry)) {
+      fprintf(stderr, "%s: truncated primes checkpoint\n", file_name);
+      exit(10);
+    }
+    add_index_entry(entry[0], entry[1], entry[2]);
+  }
+  fclose(file);
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt einen Checkpoint, sofern der nächste fällig ist und das Sieb noch
+  nicht am Ende ist; next_byte ist der Beginn des nächsten Segments.
+
+  Vorher wird die Ausgabe bis hierher geschrieben (mit der Pipeline: bis der
+  Writer-Thread alle Puffer geschrieben hat) und auf die Platte gebracht. Der
+  Checkpoint entsteht als temporäre Datei, die dann umbenannt wird; es gibt
+  also immer einen vollständigen, der höchstens so weit ist wie die Ausgabe.
+------------------------------------------------------------------------------*/
+void save_checkpoint(uint64 next_byte) {
+  if (progress.file == NULL || next_byte > progress.n / 30 || wall_clock() < progress.due) {
+    return;
+  }
+  uint32 phase = enter_phase(PHASE_OUTPUT);
+  if (!output.count_only) {
+    if (output.pos > output.buffers[output.buffer]) {
+      flush_output();
+    }
+    if (output.pipelined) {
+      wait_for_space(&output.flushed, 1);
+    }
+    sync_file(stdout, "output");
+  }
+
+  char temp_name[4096];
+  char header[CHECKPOINT_HEADER_SIZE];
+  char* pos = header;
+  if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", progress.file) >= (int) sizeof(temp_name)) {
+    fprintf(stderr, "%s: file name too long\n", progress.file);
+    exit(10);
+  }
+  memcpy(pos, "PRIMECKP", 8);
+  pos = put_uint64(pos + 8, progress.n_start);
+  pos = put_uint64(pos, progress.n);
+  pos = put_uint64(pos, progress.format);
+  pos = put_uint64(pos, next_byte);
+  pos = put_uint64(pos, primes_counted);
+  pos = put_uint64(pos, output.written);
+  pos = put_uint64(pos, output.count);
+  pos = put_uint64(pos, output.last_prime);
+  pos = put_uint64(pos, output.first_serial);
+  pos = put_uint64(pos, output.first_prime);
+  pos = put_uint64(pos, output.last_serial);
+  put_uint64(pos, output.index_count);
+
+  FILE* file = fopen(temp_name, "wb");
+  if (file == NULL || fwrite(header, 1, CHECKPOINT_HEADER_SIZE, file) != CHECKPOINT_HEADER_SIZE) {
+    checkpoint_error(temp_name);
+  }
+  for (uint32 i = 0; i < output.index_count; i++) {
+    char entry[24];
+    put_uint64(entry, output.index[i].serial);
+    put_uint64(entry + 8, output.index[i].prime);
+    put_uint64(entry + 16, output.index[i].offset);
+    if (fwrite(entry, 1, sizeof(entry), file) != sizeof(entry)) {
+      checkpoint_error(temp_name);
+    }
+  }
+  sync_file(file, temp_name);
+  if (fclose(file) != 0) {
+    checkpoint_error(temp_name);
+  }
+#ifdef _WIN32
+  if (!MoveFileExA(temp_name, progress.file, MOVEFILE_REPLACE_EXISTING)) {
+#else
+  if (rename(temp_name, progress.file) != 0) {
+#endif
+    checkpoint_error(progress.file);
+  }
+  progress.due = wall_clock() + CHECKPOINT_INTERVAL;
+  enter_phase(phase);
+}
+
+/*------------------------------------------------------------------------------
+  Bringt eine Datei auf die Platte.
+------------------------------------------------------------------------------*/
+void sync_file(FILE* file, const char* file_name) {
+#ifdef _WIN32
+  if (fflush(file) != 0 || _commit(_fileno(file)) != 0) {
+#else
+  if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+#endif
+    checkpoint_error(file_name);
+  }
+}
+
+void checkpoint_error(const char* file_name) {
+  perror(file_name);
+  exit(10);
+}
+
+/*==============================================================================
+  Index mit pi(k * 2^32)
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Bildet eine Index-Datei in den Speicher ab.
+------------------------------------------------------------------------------*/
+void open_pi_index(PiIndex* index, const char* file_name) {
+  if (!map_file(&index->map, file_name)) {
+    index_error(file_name);
+  }
+  if (index->map.size < PI_INDEX_HEADER_SIZE + 8 || memcmp(index->map.data, "PRIMEPI1", 8) != 0) {
+    fprintf(stderr, "%s: not a primes index file\n", file_name);
+    exit(6);
+  }
+  memcpy(&index->interval, index->map.data + 8, sizeof(uint64));
+  index->count = (index->map.size - PI_INDEX_HEADER_SIZE) / 8;
+}
+
+/*------------------------------------------------------------------------------
+  Liefert den letzten Stützpunkt <= x und pi(Stützpunkt).
+------------------------------------------------------------------------------*/
+uint64 lookup_pi_index(const PiIndex* index, uint64 x, uint64* checkpoint) {
+  uint64 k = x / index->interval;
+  uint64 pi;
+
+  if (k >= index->count) {
+    k = index->count - 1;
+  }
+  *checkpoint = k * index->interval;
+  memcpy(&pi, index->map.data + PI_INDEX_HEADER_SIZE + 8 * k, sizeof(uint64));
+  return pi;
+}
+
+/*------------------------------------------------------------------------------
+  Gibt die Abbildung der Index-Datei wieder frei.
+------------------------------------------------------------------------------*/
+void close_pi_index(PiIndex* index) {
+  unmap_file(&index->map);
+}
+
+/*------------------------------------------------------------------------------
+  Erstellt eine Index-Datei mit pi(k * 2^32) für alle k * 2^32 <= n bzw. setzt
+  sie ab ihrem letzten Stützpunkt fort. Jeder Stützpunkt wird sofort
+  geschrieben, ein abgebrochener Lauf kann also einfach fortgesetzt werden.
+------------------------------------------------------------------------------*/
+void build_pi_index(const Parameters* p) {
+  uint64 n = p->n;
+  char entry[PI_INDEX_HEADER_SIZE];
+  uint64 interval = PI_INDEX_INTERVAL;
+  uint64 k = 0;
+  uint64 pi = 0;
+
+  FILE* file = fopen(p->index_file, "r+b");
+  if (file == NULL) {
+    if ((file = fopen(p->index_file, "w+b")) == NULL) {
+      index_error(p->index_file);
+    }
+    /* Kopf und pi(0) = 0 */
+    memcpy(entry, "PRIMEPI1", 8);
+    put_uint64(entry + 8, interval);
+    if (fwrite(entry, 1, PI_INDEX_HEADER_SIZE, file) != PI_INDEX_HEADER_SIZE) {
+      index_error(p->index_file);
+    }
+    put_uint64(entry, 0);
+    if (fwrite(entry, 1, 8, file) != 8) {
+      index_error(p->index_file);
+    }
+  } else {
+    if (   fread(entry, 1, PI_INDEX_HEADER_SIZE, file) != PI_INDEX_HEADER_SIZE
+        || memcmp(entry, "PRIMEPI1", 8) != 0) {
+      fprintf(stderr, "%s: not a primes index file\n", p->index_file);
+      exit(6);
+    }
+    memcpy(&interval, entry + 8, sizeof(uint64));
+    if (fseek(file, -8, SEEK_END) != 0 || fread(&pi, 1, 8, file) != 8 || fseek(file, 0, SEEK_END) != 0) {
+      index_error(p->index_file);
+    }
+    k = (uint64) (ftell(file) - PI_INDEX_HEADER_SIZE) / 8 - 1;
+  }
+
+  if (n / interval > k) {
+    enter_phase(PHASE_BASE);
+    primes_init_wheel();
+
+    uint32 sqrts[5];
+    uint32 sqrts_top = primes_calc_square_roots(n, sqrts);
+    PrimeFactors factors;
+    primes_build_prime_factors(&factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+    uint32 sieve_size = primes_calc_sieve_size(n, p->sieve_size);
+    uint8* sieve = primes_build_sieve(sieve_size);
+    get_prime_factors(p->base_file, sqrts_top, sqrts, &factors, sieve, sieve_size);
+
+    /* ab dem letzten Stützpunkt zählen; 2, 3 und 5 hat das Sieb nicht */
+    uint64 from = k * interval + 1;
+    if (k == 0) {
+      from = 7;
+      pi = 3;
+    }
+
+    SegmentedSieve s;
+    uint64 segments = 0;
+    primes_init_segmented_sieve(&s, &factors, factors.count, sieve_size, n);
+    for (uint64 low_byte = from / 30; k < n / interval; low_byte += sieve_size) {
+      enter_phase(PHASE_SIEVE);
+      primes_sieve_next_segment(&s, sieve, low_byte);
+      segments += 1;
+
+      enter_phase(PHASE_SCAN);
+      primes_limit_segment(sieve, low_byte, sieve_size, from, n);
+
+      uint64 high = (low_byte + sieve_size) * 30;
+      for (; k < n / interval && (k + 1) * interval < high; k++) {
+        put_uint64(entry, pi + primes_count_segment_primes_up_to(sieve, low_byte, (k + 1) * interval));
+        if (fwrite(entry, 1, 8, file) != 8 || fflush(file) != 0) {
+          index_error(p->index_file);
+        }
+      }
+      pi += primes_count_segment_primes(sieve, sieve_size);
+    }
+    enter_phase(PHASE_OTHER);
+    count_sieve_work(from / 30, segments, &factors, sieve_size);
+    primes_free_segmented_sieve(&s);
+    free(sieve);
+    primes_free_prime_factors(&factors);
+  }
+
+  if (fclose(file) != 0) {
+    index_error(p->index_file);
+  }
+  printf("%" PRIu64 " checkpoints up to %" PRIu64 " (every %" PRIu64 ")\n", k + 1, k * interval, interval);
+}
+
+/*------------------------------------------------------------------------------
+  Bricht bei einem Fehler mit der Index-Datei ab.
+------------------------------------------------------------------------------*/
+void index_error(const char* file_name) {
+  perror(file_name);
+  exit(6);
+}
+
+/*==============================================================================
+  Datei mit den Primfaktoren bis 2^32
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Bildet eine Datei (nur lesbar) in den Speicher ab; 0 bei einem Fehler.
+------------------------------------------------------------------------------*/
+int map_file(MappedFile* map, const char* file_name) {
+#ifdef _WIN32
+  LARGE_INTEGER size;
+  map->file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+  if (   map->file == INVALID_HANDLE_VALUE
+      || !GetFileSizeEx(map->file, &size) || size.QuadPart == 0
+      || (map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL
+      || (map->data = MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL) {
+    return 0;
+  }
+  map->size = (uint64) size.QuadPart;
+#else
+  struct stat st;
+  int fd = open(file_name, O_RDONLY);
+  if (   fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0
+      || (map->data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    return 0;
+  }
+  close(fd);
+  map->size = (uint64) st.st_size;
+#endif
+  return 1;
+}
+
+/*------------------------------------------------------------------------------
+  Gibt die Abbildung einer Datei wieder frei.
+------------------------------------------------------------------------------*/
+void unmap_file(MappedFile* map) {
+#ifdef _WIN32
+  UnmapViewOfFile(map->data);
+  CloseHandle(map->mapping);
+  CloseHandle(map->file);
+#else
+  munmap((void*) map->data, (size_t) map->size);
+#endif
+}
+
+/*------------------------------------------------------------------------------
+  Ermittelt die Primfaktoren bis sqrts[0]: aus der Primfaktor-Datei, sofern
+  angegeben, sonst per Sieb (primes_calc_prime_factors).
+------------------------------------------------------------------------------*/
+void get_prime_factors(const char* base_file, uint32 sqrts_top, uint32* sqrts, PrimeFactors* factors, uint8* sieve, uint32 sieve_size) {
+  if (base_file != NULL) {
+    load_prime_factors(base_file, sqrts[0], factors);
+  } else {
+    primes_calc_prime_factors(sqrts_top, sqrts, factors, sieve, sieve_size);
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Übernimmt die Primfaktoren (ab 7) bis sqrt_n aus der Primfaktor-Datei; die
+  Abstände haben dort schon das Format von PrimeFactors.
+------------------------------------------------------------------------------*/
+void load_prime_factors(const char* base_file, uint32 sqrt_n, PrimeFactors* factors) {
+  MappedFile map;
+  uint64 count, largest;
+
+  if (!map_file(&map, base_file)) {
+    base_file_error(base_file);
+  }
+  if (map.size < BASE_FILE_HEADER_SIZE || memcmp(map.data, "PRIMEBAS", 8) != 0) {
+    fprintf(stderr, "%s: not a primes base file\n", base_file);
+    exit(8);
+  }
+  memcpy(&count, map.data + 8, sizeof(uint64));
+  memcpy(&largest, map.data + 16, sizeof(uint64));
+  if (map.size != BASE_FILE_HEADER_SIZE + count) {
+    fprintf(stderr, "%s: truncated primes base file\n", base_file);
+    exit(8);
+  }
+  if (largest < sqrt_n && largest < 4294967291U) {  /* größte Primzahl < 2^32 */
+    fprintf(stderr, "%s: contains the prime factors up to %" PRIu64 " only\n", base_file, largest);
+    exit(8);
+  }
+
+  const uint8* gaps = map.data + BASE_FILE_HEADER_SIZE;
+  uint64 prime = 5;
+  for (uint32 i = 0; i < count && prime + 2 * gaps[i] <= sqrt_n; i++) {
+    prime += 2 * gaps[i];
+    primes_add_prime_factor(factors, (uint32) prime);
+  }
+  unmap_file(&map);
+}
+
+/*------------------------------------------------------------------------------
+  Schreibt die Primfaktoren bis 2^32 (ab 7) als halbe Abstände in die
+  Primfaktor-Datei.
+------------------------------------------------------------------------------*/
+void build_base_file(const Parameters* p) {
+  uint32 sqrts[5];
+  uint32 sqrts_top = primes_calc_square_roots(18446744073709551615ULL, sqrts);
+  char header[BASE_FILE_HEADER_SIZE];
+
+  enter_phase(PHASE_BASE);
+  primes_init_wheel();
+  PrimeFactors factors;
+  primes_build_prime_factors(&factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+  uint32 sieve_size = primes_calc_sieve_size(18446744073709551615ULL, p->sieve_size);
+  uint8* sieve = primes_build_sieve(sieve_size);
+  primes_calc_prime_factors(sqrts_top, sqrts, &factors, sieve, sieve_size);
+
+  enter_phase(PHASE_OUTPUT);
+  FILE* file = fopen(p->base_file, "wb");
+  memcpy(header, "PRIMEBAS", 8);
+  put_uint64(header + 8, factors.count);
+  put_uint64(header + 16, factors.largest);
+  if (   file == NULL || fwrite(header, 1, BASE_FILE_HEADER_SIZE, file) != BASE_FILE_HEADER_SIZE
+      || fwrite(factors.gaps, 1, factors.count, file) != factors.count) {
+    base_file_error(p->base_file);
+  }
+  if (fclose(file) != 0) {
+    base_file_error(p->base_file);
+  }
+  enter_phase(PHASE_OTHER);
+  printf("%u prime factors up to %u\n", factors.count, factors.largest);
+  free(sieve);
+  primes_free_prime_factors(&factors);
+}
+
+/*------------------------------------------------------------------------------
+  Bricht bei einem Fehler mit der Primfaktor-Datei ab.
+------------------------------------------------------------------------------*/
+void base_file_error(const char* file_name) {
+  perror(file_name);
+  exit(8);
+}
+
+/*==============================================================================
+  Server (--server)
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Berechnet die Primfaktoren bis 2^32 und beantwortet dann Anfragen von stdin
+  bzw. über das Socket, bis stdin endet (das Socket wird nicht beendet).
+
+  Der Haupt-Thread nimmt die Verbindungen an und reiht sie ein, die Threads
+  des Pools bedienen sie mit je einem eigenen Sieb-Segment; die Primfaktoren
+  werden nur gelesen.
+------------------------------------------------------------------------------*/
+void run_server(const Parameters* p) {
+  uint32 sqrts[5];
+  uint32 sqrts_top = primes_calc_square_roots(18446744073709551615ULL, sqrts);
+
+  primes_init_wheel();
+  server.sieve_size = primes_calc_sieve_size(18446744073709551615ULL, p->sieve_size);
+  uint8* sieve = primes_build_sieve(server.sieve_size);
+  primes_build_prime_factors(&server.factors, primes_estimate_number_of_primes_up_to(sqrts[0]));
+  get_prime_factors(p->base_file, sqrts_top, sqrts, &server.factors, sieve, server.sieve_size);
+
+  if (p->server_socket == NULL) {
+    serve_connection(stdin, stdout, sieve);
+    free(sieve);
+    primes_free_prime_factors(&server.factors);
+    return;
+  }
+#ifdef _WIN32
+  fprintf(stderr, "%s: Unix domain sockets are not supported on Windows\n", p->server_socket);
+  exit(7);
+#else
+  int listener = open_server_socket(p->server_socket);
+  free(sieve);
+  signal(SIGPIPE, SIG_IGN);  /* Abbruch einer Verbindung beendet nur diese */
+  pthread_mutex_init(&server.lock, NULL);
+  pthread_cond_init(&server.not_empty, NULL);
+  pthread_cond_init(&server.not_full, NULL);
+  server.first = 0;
+  server.count = 0;
+  for (uint32 i = 0; i < p->threads_count; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, serve_connections, NULL) != 0) {
+      perror("thread error");
+      exit(4);
+    }
+    pthread_detach(thread);
+  }
+
+  for (;;) {
+    int connection = accept(listener, NULL, NULL);
+    if (connection < 0) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        perror(p->server_socket);
+        exit(7);
+      }
+      continue;
+    }
+    pthread_mutex_lock(&server.lock);
+    while (server.count == SERVER_QUEUE_SIZE) {
+      pthread_cond_wait(&server.not_full, &server.lock);
+    }
+    server.connections[(server.first + server.count++) % SERVER_QUEUE_SIZE] = connection;
+    pthread_cond_signal(&server.not_empty);
+    pthread_mutex_unlock(&server.lock);
+  }
+#endif
+}
+
+/*------------------------------------------------------------------------------
+  Beantwortet die Anfragen einer Verbindung, bis sie endet.
+
+  Eine zu lange Zeile wird bis zu ihrem Ende übergangen und bekommt genau eine
+  Fehlermeldung; sonst käme ihr Rest als weitere Anfrage an, und Anfragen und
+  Antworten passten danach nicht mehr zueinander.
+------------------------------------------------------------------------------*/
+void serve_connection(FILE* in, FILE* out, uint8* sieve) {
+  char line[SERVER_LINE_SIZE];
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    int answered;
+    if (strchr(line, '\n') == NULL && !feof(in)) {
+      int c;
+      while ((c = getc(in)) != EOF && c != '\n') {
+      }
+      answered = fprintf(out, "error: query longer than %d characters\n\n", SERVER_LINE_SIZE - 2) > 0;
+    } else {
+      answered = answer_query(line, out, sieve);
+    }
+    if (!answered || fflush(out) != 0) {
+      return;
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Beantwortet eine Anfrage; 0, wenn die Antwort nicht geschrieben werden kann.
+------------------------------------------------------------------------------*/
+int answer_query(const char* line, FILE* out, uint8* sieve) {
+  char command[16], from_token[32], to_token[32];
+  uint64 from, to;
+  int tokens = sscanf(line, "%15s %31s %31s", command, from_token, to_token);
+
+  if (tokens == 2 && strcmp(command, "nth") == 0 && parse_number(from_token, &from)) {
+    if (from == 0 || from > PI_MAX) {
+      return fprintf(out, "error: k must be in [1, %" PRIu64 "]\n\n", (uint64) PI_MAX) > 0;
+    }
+    uint64 prime = primes_find_nth_prime(from, &server.factors, sieve, server.sieve_size);
+    return fprintf(out, "%" PRIu64 "\n\n", prime) > 0;
+  }
+  if (tokens != 3 || !parse_number(from_token, &from) || !parse_number(to_token, &to)) {
+    return fprintf(out, "error: expected \"range m n\", \"count m n\" or \"nth k\"\n\n") > 0;
+  }
+  if (strcmp(command, "range") == 0) {
+    sieve_window(from, to, sieve, out);
+    return fprintf(out, "\n") > 0;
+  }
+  if (strcmp(command, "count") == 0) {
+    return fprintf(out, "%" PRIu64 "\n\n", sieve_window(from, to, sieve, NULL)) > 0;
+  }
+  return fprintf(out, "error: unknown query \"%s\"\n\n", command) > 0;
+}
+
+/*------------------------------------------------------------------------------
+  Siebt den Bereich von from bis to mit den Primfaktoren bis sqrt(to) und
+  schreibt die Primzahlen nach out (bzw. zählt sie nur, wenn out NULL ist).
+  Zurückgegeben wird die Anzahl der Primzahlen.
+
+  Ein schmaler Bereich wird wie bei -p per Miller-Rabin-Test geprüft: für ihn
+  alle Primfaktoren bis sqrt(to) in die Buckets zu verteilen, kostete mehr.
+------------------------------------------------------------------------------*/
+uint64 sieve_window(uint64 from, uint64 to, uint8* sieve, FILE* out) {
+  static const uint32 small_primes[3] = { 2, 3, 5 };
+  uint64 count = 0;
+  char line[OUTPUT_LINE_SIZE];
+  uint64 numbers[IS_PRIME_BATCH_SIZE];
+  uint8 results[IS_PRIME_BATCH_SIZE];
+
+  for (uint32 i = 0; i < 3; i++) {
+    if (small_primes[i] >= from && small_primes[i] <= to) {
+      count += 1;
+      if (out != NULL) {
+        char* end = format_number(line, small_primes[i]);
+        *end++ = '\n';
+        fwrite(line, 1, end - line, out);
+      }
+    }
+  }
+  if (to < 7 || from > to) {
+    return count;
+  }
+  from = (from > 7) ? from : 7;
+
+  /* Primfaktoren bis sqrt(to): Primzahlen werden selbst nie gestrichen, es
+     darf also auch über die Primfaktoren hinweg gesiebt werden */
+  uint32 sqrts[5];
+  primes_calc_square_roots(to, sqrts);
+  uint32 sqrt_to = sqrts[0];
+  if (to - from < sqrt_to / IS_PRIME_WINDOW_RATIO) {
+    uint64 base = from / 30;
+    uint32 candidates;
+    while ((candidates = next_candidates(&base, from, to, numbers)) > 0) {
+      primes_is_prime_batch(numbers, candidates, results);
+      for (uint32 i = 0; i < candidates; i++) {
+        if (results[i]) {
+          count += 1;
+          if (out != NULL) {
+            char* end = format_number(line, numbers[i]);
+            *end++ = '\n';
+            fwrite(line, 1, end - line, out);
+          }
+        }
+      }
+    }
+    return count;
+  }
+
+  SegmentedSieve s;
+  primes_init_segmented_sieve(&s, &server.factors, primes_count_prime_factors_up_to(sqrt_to, &server.factors), server.sieve_size, to);
+  for (uint64 low_byte = from / 30; low_byte <= to / 30; low_byte += server.sieve_size) {
+    primes_sieve_next_segment(&s, sieve, low_byte);
+    primes_limit_segment(sieve, low_byte, server.sieve_size, from, to);
+    if (out == NULL) {
+      count += primes_count_segment_primes(sieve, server.sieve_size);
+      continue;
+    }
+    for (uint32 j = 0; j < server.sieve_size; j += 8) {
+      uint64 word;
+      memcpy(&word, sieve + j, sizeof(word));
+      while (word != 0) {
+        char* end = format_number(line, (low_byte + j) * 30 + primes_wheel_offsets[ctz64(word)]);
+        *end++ = '\n';
+        fwrite(line, 1, end - line, out);
+        word &= word - 1;
+        count += 1;
+      }
+    }
+  }
+  primes_free_segmented_sieve(&s);
+  return count;
+}
+
+/*------------------------------------------------------------------------------
+  Liest eine Zahl; 0, wenn token keine (passende) Zahl ist.
+------------------------------------------------------------------------------*/
+int parse_number(const char* token, uint64* x) {
+  *x = atoul(token);
+  return *x != 0 || strcmp(token, "0") == 0;
+}
+
+#ifndef _WIN32
+/*------------------------------------------------------------------------------
+  Legt das Unix-Domain-Socket an; eine verwaiste Socket-Datei wird ersetzt.
+------------------------------------------------------------------------------*/
+int open_server_socket(const char* path) {
+  struct sockaddr_un address;
+  struct stat st;
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (listener < 0 || strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "%s: cannot create socket\n", path);
+    exit(7);
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+  if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SERVER_QUEUE_SIZE) != 0) {
+    perror(path);
+    exit(7);
+  }
+  return listener;
+}
+
+/*------------------------------------------------------------------------------
+  Thread des Pools: bedient eingereihte Verbindungen nacheinander.
+------------------------------------------------------------------------------*/
+void* serve_connections(void* arg) {
+  uint8* sieve = primes_build_sieve(server.sieve_size);
+
+  (void) arg;
+  for (;;) {
+    pthread_mutex_lock(&server.lock);
+    while (server.count == 0) {
+      pthread_cond_wait(&server.not_empty, &server.lock);
+    }
+    int connection = server.connections[server.first];
+    server.first = (server.first + 1) % SERVER_QUEUE_SIZE;
+    server.count -= 1;
+    pthread_cond_signal(&server.not_full);
+    pthread_mutex_unlock(&server.lock);
+
+    int copy = dup(connection);
+    FILE* in = fdopen(connection, "r");
+    FILE* out = (copy >= 0) ? fdopen(copy, "w") : NULL;
+    if (in != NULL && out != NULL) {
+      serve_connection(in, out, sieve);
+    }
+    if (out != NULL) {
+      fclose(out);
+    } else if (copy >= 0) {
+      close(copy);
+    }
+    if (in != NULL) {
+      fclose(in);
+    } else {
+      close(connection);
+    }
+  }
+  return NULL;
+}
+#endif
+
+/*==============================================================================
+  Statistik (--stats)
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Bereitet die Statistik vor. Unter Linux werden dafür Hardware-Zähler für den
+  Prozess geöffnet (inherit: samt der später gestarteten Threads); fehlen die
+  Rechte oder die Zähler, dann bleibt es bei Zeiten und Anzahlen.
+------------------------------------------------------------------------------*/
+void init_stats(int enabled) {
+  memset(&stats, 0, sizeof(stats));
+  stats.enabled = enabled;
+  for (uint32 i = 0; i < EVENTS_COUNT; i++) {
+    stats.events_fd[i] = -1;
+  }
+  if (!enabled) {
+    return;
+  }
+
+#ifdef __linux__
+  const uint32 types[EVENTS_COUNT] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+  };
+  const uint64 configs[EVENTS_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+  for (uint32 i = 0; i < EVENTS_COUNT; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[i];
+    attr.config = configs[i];
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    stats.events_fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (stats.events_fd[i] < 0) {
+      stats.events_error = errno;
+    }
+  }
+#endif
+
+  stats.phase = PHASE_OTHER;
+  stats.start = wall_clock();
+  stats.primes_start = primes_counted;
+  read_events(stats.events_start);
+}
+
+/*------------------------------------------------------------------------------
+  Schließt die aktuelle Phase ab und beginnt die Phase phase.
+  Zurückgegeben wird die bisherige Phase.
+------------------------------------------------------------------------------*/
+uint32 enter_phase(uint32 phase) {
+  if (!stats.enabled) {
+    return PHASE_OTHER;
+  }
+
+  uint32 previous = stats.phase;
+  Phase* current = &stats.phases[previous];
+  uint64 events[EVENTS_COUNT];
+  double now = wall_clock();
+
+  read_events(events);
+  current->wall += now - stats.start;
+  current->primes += primes_counted - stats.primes_start;
+  for (uint32 i = 0; i < EVENTS_COUNT; i++) {
+    current->events[i] += events[i] - stats.events_start[i];
+    stats.events_start[i] = events[i];
+  }
+  stats.phase = phase;
+  stats.start = now;
+  stats.primes_start = primes_counted;
+  return previous;
+}
+
+/*------------------------------------------------------------------------------
+  Liest die Hardware-Zähler. Mussten sie sich die Register mit anderen teilen,
+  wird auf die ganze Laufzeit hochgerechnet.
+------------------------------------------------------------------------------*/
+void read_events(uint64* values) {
+  for (uint32 i = 0; i < EVENTS_COUNT; i++) {
+    values[i] = 0;
+#ifdef __linux__
+    uint64 data[3];  /* Wert, Zeit aktiviert, Zeit gezählt */
+    if (   stats.events_fd[i] >= 0
+        && read(stats.events_fd[i], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+      values[i] = (data[2] < data[1]) ? (uint64) ((double) data[0] * data[1] / data[2]) : data[0];
+    }
+#endif
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Berechnet für das Sieben von segments Segmenten ab dem Byte low_byte die
+  Anzahl der Segmente und der gestrichenen Vielfachen, also der Schreibzugriffe
+  in cross_off_multiples und cross_off_large_primes.
+
+  Gestrichen werden für jeden Primfaktor p > 19 (die kleineren stecken im
+  Vorsieb) die Vielfachen p * f mit f >= p und f teilerfremd zu 30 im gesiebten
+  Bereich. Das lässt sich ohne Zähler in den inneren Schleifen ausrechnen.
+------------------------------------------------------------------------------*/
+void count_sieve_work(uint64 low_byte, uint64 segments, const PrimeFactors* factors, uint32 sieve_size) {
+  if (!stats.enabled) {
+    return;
+  }
+
+  uint64 high_byte = low_byte + segments * sieve_size;
+  uint64 low = low_byte * 30;
+  uint64 high = (high_byte > 18446744073709551615ULL / 30) ? 18446744073709551615ULL : high_byte * 30 - 1;
+  uint64 cross_offs = 0;
+
+  uint64 prime = 5;
+  for (uint32 i = 0; i < factors->count; i++) {
+    prime += 2 * factors->gaps[i];
+    if (prime <= 19) {
+      continue;
+    }
+    uint64 f_min = low / prime + (low % prime != 0);
+    uint64 f_max = high / prime;
+    if (f_min < prime) {
+      f_min = prime;
+    }
+    if (f_max >= f_min) {
+      cross_offs += count_coprime_to_30(f_max) - count_coprime_to_30(f_min - 1);
+    }
+  }
+  stats.phases[PHASE_SIEVE].segments += segments;
+  stats.phases[PHASE_SIEVE].cross_offs += cross_offs;
+}
+
+/*------------------------------------------------------------------------------
+  Anzahl der zu 30 teilerfremden Zahlen von 1 bis x.
+------------------------------------------------------------------------------*/
+uint64 count_coprime_to_30(uint64 x) {
+  static const uint8 below[30] = { 0, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 4, 4,
+                                   4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 8 };
+  return x / 30 * 8 + below[x % 30];
+}
+
+/*------------------------------------------------------------------------------
+  Gibt die Statistik je Phase auf stderr aus.
+------------------------------------------------------------------------------*/
+void print_stats(void) {
+  Phase total;
+  int events_available = 0;
+
+  enter_phase(PHASE_OTHER);
+  memset(&total, 0, sizeof(total));
+
+  fprintf(stderr, "%-12s %10s %14s %10s %16s", "phase", "wall_s", "primes", "segments", "cross-offs");
+  for (uint32 i = 0; i < EVENTS_COUNT; i++) {
+    if (stats.events_fd[i] >= 0) {
+      fprintf(stderr, " %16s", event_names[i]);
+      events_available = 1;
+    }
+  }
+  fprintf(stderr, "\n");
+
+  for (uint32 k = 0; k <= PHASES_COUNT; k++) {
+    Phase* phase = (k < PHASES_COUNT) ? &stats.phases[k] : &total;
+    if (k < PHASES_COUNT) {
+      total.wall += phase->wall;
+      total.primes += phase->primes;
+      total.segments += phase->segments;
+      total.cross_offs += phase->cross_offs;
+      for (uint32 i = 0; i < EVENTS_COUNT; i++) {
+        total.events[i] += phase->events[i];
+      }
+    }
+    fprintf(stderr, "%-12s %10.3f %14" PRIu64 " %10" PRIu64 " %16" PRIu64, (k < PHASES_COUNT) ? phase_names[k] : "total",
+            phase->wall, phase->primes, phase->segments, phase->cross_offs);
+    for (uint32 i = 0; i < EVENTS_COUNT; i++) {
+      if (stats.events_fd[i] >= 0) {
+        fprintf(stderr, " %16" PRIu64, phase->events[i]);
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+
+  if (!events_available) {
+#ifdef __linux__
+    fprintf(stderr, "no hardware counters (perf_event_open: %s)\n", strerror(stats.events_error));
+#else
+    fprintf(stderr, "no hardware counters on this platform\n");
+#endif
+  }
+}
+
+/*------------------------------------------------------------------------------
+  Liefert eine fortlaufende Zeit in Sekunden.
+------------------------------------------------------------------------------*/
+double wall_clock(void) {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double) counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/*==============================================================================
+  allgemeine Funktionen
+==============================================================================*/
+
+/*------------------------------------------------------------------------------
+  Ermittelt die Anzahl der verfügbaren Prozessoren.
+------------------------------------------------------------------------------*/
+uint32 count_processors(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? (uint32) count : 1;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+  convert a string to an unsigned long integer
+------------------------------------------------------------------------------*/
+uint64 atoul(const char* str) {
+  uint64 ull = 0;
+
+  while (*str != 0) {
+    if ((*str < '0' || *str > '9')
+      || ull > 1844674407370955161ULL
+      || (ull *= 10) > 18446744073709551615ULL - (*str - '0')) {
+      return 0;
+    }
+    ull += (*str++ - '0');
+  }
+  return ull;
 }
@@ -18,3 +18,56 @@ for mn in \
   ./primes $mn || return
   echo ----------------------------------------
 done
+
+# ----------------------------------------------------------------------
+# --- compare the newer modes with plain runs (needs make all)
+# ----------------------------------------------------------------------
+tmp=$(mktemp -d)
+failed=0
+check () {
+  if [ "$2" = "$3" ]; then
+    echo "ok: $1"
+  else
+    echo "FAILED: $1"
+    failed=1
+  fi
+}
+
+# --- Miller-Rabin: strong pseudoprimes to several bases, 2^64 - 59
+check "--is-prime" "$(echo 3215031751 3825123056546413051 18446744073709551557 | ./primes --is-prime)" \
+"3215031751 is not prime
+3825123056546413051 is not prime
+18446744073709551557 is prime"
+
+# --- narrow window below 2^64: Miller-Rabin instead of all prime factors up to 2^32
+timeout 2 ./primes -p 18446744073709541615 18446744073709551615 > $tmp/narrow
+check "narrow -p window within 2 s" "$?:$(wc -l < $tmp/narrow):$(tail -1 $tmp/narrow)" "0:218:18446744073709551557"
+
+# --- binary output and primes-decode
+./primes -b 1000000000 1001000000 > $tmp/b
+check "-b / primes-decode" "$(./primes-decode $tmp/b | md5sum)" "$(./primes 1000000000 1001000000 | md5sum)"
+check "-b / primes-decode -p" "$(./primes-decode -p $tmp/b | md5sum)" "$(./primes -p 1000000000 1001000000 | md5sum)"
+
+# --- --shard i/N and primes-merge
+for i in 1 2 3; do
+  ./primes --shard $i/3 $tmp/m$i 1000000000 1100000000 > $tmp/s$i
+done
+check "--shard / primes-merge" "$(./primes-merge $tmp/m1 $tmp/s1 $tmp/m2 $tmp/s2 $tmp/m3 $tmp/s3 | md5sum)" \
+      "$(./primes 1000000000 1100000000 | md5sum)"
+
+# --- --checkpoint (about once a minute), kill, --resume
+./primes -c --checkpoint $tmp/ckp 10000000000000 10030000000000 > $tmp/c &
+pid=$!
+while kill -0 $pid 2> /dev/null && [ ! -f $tmp/ckp ]; do
+  sleep 1
+done
+if kill $pid 2> /dev/null; then
+  wait $pid
+  ./primes -c --checkpoint $tmp/ckp --resume 10000000000000 10030000000000 > $tmp/c
+  check "--checkpoint / --resume" "$(cat $tmp/c)" "$(./primes -c 10000000000000 10030000000000)"
+else
+  echo "skipped: --checkpoint / --resume (finished before the first checkpoint)"
+fi
+
+rm -rf $tmp
+[ $failed = 0 ]